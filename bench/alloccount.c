@@ -0,0 +1,43 @@
+/*
+ * Allocation counter for bench/run.sh, preloaded into mlsblk
+ * (LD_PRELOAD on Linux, DYLD_INSERT_LIBRARIES on macOS). At exit it writes
+ * "ALLOCS BYTES" to the file named by $ALLOCCOUNT_FILE.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static unsigned long long nallocs, nbytes;
+
+#ifdef __APPLE__
+static void *count_malloc(size_t n) { nallocs++; nbytes += n; return malloc(n); }
+static void *count_calloc(size_t k, size_t n) { nallocs++; nbytes += k * n; return calloc(k, n); }
+static void *count_realloc(void *p, size_t n) { nallocs++; nbytes += n; return realloc(p, n); }
+
+__attribute__((used, section("__DATA,__interpose"))) static const struct { const void *with, *orig; } interpose[] = {
+	{ (const void *)count_malloc, (const void *)malloc },
+	{ (const void *)count_calloc, (const void *)calloc },
+	{ (const void *)count_realloc, (const void *)realloc },
+};
+#else
+/* glibc's own entry points, so the wrappers need no dlsym() */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t n) { nallocs++; nbytes += n; return __libc_malloc(n); }
+void *calloc(size_t k, size_t n) { nallocs++; nbytes += k * n; return __libc_calloc(k, n); }
+void *realloc(void *p, size_t n) { nallocs++; nbytes += n; return __libc_realloc(p, n); }
+#endif
+
+__attribute__((destructor)) static void report(void) {
+	const char *path = getenv("ALLOCCOUNT_FILE");
+	if (!path) return;
+	char buf[64];
+	int len = snprintf(buf, sizeof(buf), "%llu %llu\n", nallocs, nbytes);
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return;
+	if (write(fd, buf, (size_t)len) < 0) { /* nothing to do */ }
+	close(fd);
+}
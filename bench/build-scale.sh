@@ -0,0 +1,17 @@
+#!/bin/sh
+# Tree construction scaling: replay synthetic listings of 10..100k devices
+# and report wall time per device. Flat ns/device means linear build time.
+#   usage: bench/build-scale.sh [mlsblk-binary]
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+tmp=${TMPDIR:-/tmp}/mlsblk-build-scale.$$
+trap 'rm -rf "$tmp"' EXIT
+
+printf '%8s %10s %12s\n' devices seconds ns/device
+for n in 10 100 1000 10000 100000; do
+	gen_list "$tmp/$n" "$n"
+	t=$(best_of 3 "$bin" --replay "$tmp/$n" -l -o NAME)
+	printf '%8s %10s %12s\n' "$n" "$t" "$(echo "$t $n" | awk '{ printf "%.0f", $1 * 1e9 / $2 }')"
+done
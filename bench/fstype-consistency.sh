@@ -0,0 +1,31 @@
+#!/bin/sh
+# Check that FSTYPE does not depend on the other requested columns: with -f,
+# -o NAME,FSTYPE must agree with the FSTYPE column of wider column sets, on a
+# mlsblk-gen fixture and on bench/fake-diskutil with both --info modes.
+#   usage: bench/fstype-consistency.sh [mlsblk-binary]
+
+dir=$(cd "$(dirname "$0")" && pwd)
+bin=${1:-$dir/../mlsblk}
+gen=$dir/../mlsblk-gen
+tmp=${TMPDIR:-/tmp}/mlsblk-fstype.$$
+trap 'rm -rf "$tmp" "$tmp".*' EXIT
+
+"$gen" -d 8 -l mixed "$tmp" > /dev/null || exit 1
+
+# check LABEL ARGS...: FSTYPE per device for several column sets must match
+check() {
+	what=$1; shift
+	"$bin" "$@" -f -r -o NAME,FSTYPE > "$tmp.want" || exit 1
+	for cols in NAME,FSTYPE,LABEL NAME,FSTYPE,UUID,MOUNTPOINT NAME,FSTYPE,LABEL,UUID,ROLE; do
+		"$bin" "$@" -f -r -o "$cols" | cut -d' ' -f1,2 > "$tmp.got"
+		cmp -s "$tmp.want" "$tmp.got" || { echo "fstype-consistency: $what: -o $cols differs" >&2; exit 1; }
+	done
+	"$bin" "$@" -f -r | cut -d' ' -f1,4 > "$tmp.got"
+	cmp -s "$tmp.want" "$tmp.got" || { echo "fstype-consistency: $what: -f differs" >&2; exit 1; }
+}
+check replay --replay "$tmp"
+MLSBLK_DISKUTIL=$dir/fake-diskutil FAKE_LATENCY=0 FAKE_DISKS=6
+export MLSBLK_DISKUTIL FAKE_LATENCY FAKE_DISKS
+check fake-diskutil --info=each
+check "fake-diskutil info -all" --info=all
+echo "fstype-consistency: ok"
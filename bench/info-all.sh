@@ -0,0 +1,24 @@
+#!/bin/sh
+# Time mlsblk -f with one diskutil info per device (--info=each) against one
+# diskutil info -all (--info=all), using bench/fake-diskutil, for several
+# disk counts. Both modes must print the same table.
+#   usage: bench/info-all.sh [mlsblk-binary]
+# FAKE_LATENCY is passed through to the stand-in (default here: 0.05).
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+tmp=${TMPDIR:-/tmp}/mlsblk-info-all.$$
+trap 'rm -f "$tmp".*' EXIT
+MLSBLK_DISKUTIL=$dir/fake-diskutil
+FAKE_LATENCY=${FAKE_LATENCY:-0.05}
+export MLSBLK_DISKUTIL FAKE_LATENCY
+
+printf '%-6s %9s %9s\n' disks each all
+for n in 10 40 160; do
+	export FAKE_DISKS=$n
+	"$bin" -f --info=each > "$tmp.each"
+	"$bin" -f --info=all > "$tmp.all"
+	cmp -s "$tmp.each" "$tmp.all" || { echo "info-all: output differs with $n disks" >&2; exit 1; }
+	printf '%-6s %8ss %8ss\n' "$n" "$(best_of 3 "$bin" -f --info=each)" "$(best_of 3 "$bin" -f --info=all)"
+done
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Time mlsblk -f against bench/fake-diskutil for several --jobs values.
+#   usage: bench/info-fanout.sh [mlsblk-binary]
+# FAKE_DISKS / FAKE_LATENCY are passed through to the stand-in.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+MLSBLK_DISKUTIL=$dir/fake-diskutil
+export MLSBLK_DISKUTIL
+
+for jobs in 1 2 4 8 16 32; do
+	printf 'jobs=%-3s %ss\n' "$jobs" "$(elapsed "$bin" -f --jobs "$jobs")"
+done
+printf 'adaptive %ss\n' "$(elapsed "$bin" -f)"
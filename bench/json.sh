@@ -0,0 +1,23 @@
+#!/bin/sh
+# JSON writer throughput: replay 1M devices with 100k mounts and time -J,
+# with plain mount paths and with paths that need escaping on every mount.
+#   usage: bench/json.sh [mlsblk-binary]
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+tmp=${TMPDIR:-/tmp}/mlsblk-json.$$
+trap 'rm -rf "$tmp"' EXIT
+
+cols=NAME,SIZE,TYPE,MOUNTPOINTS
+gen_list "$tmp/plain" 1000000 100000
+mkdir -p "$tmp/escaped"
+cp "$tmp/plain/list.plist" "$tmp/escaped/"
+perl -pe 's{/Volumes/mnt}{/Volumes/"q\\\tmnt\x01}g' "$tmp/plain/mounts" > "$tmp/escaped/mounts"
+for fx in plain escaped; do
+	base=$(best_of 3 "$bin" --replay "$tmp/$fx" -l -o NAME)
+	t=$(best_of 3 "$bin" --replay "$tmp/$fx" -J -o $cols)
+	bytes=$("$bin" --replay "$tmp/$fx" -J -o $cols | wc -c)
+	printf '%-8s %ss (-l -o NAME: %ss), %d bytes, %s MB/s over that\n' "$fx" "$t" "$base" "$bytes" \
+		"$(echo "$bytes $t $base" | awk '{ printf "%.0f", $1 / ($2 - $3 > 0 ? $2 - $3 : $2) / 1e6 }')"
+done
@@ -0,0 +1,86 @@
+# Shared helpers for the bench/ scripts (sourced, not run).
+
+# elapsed CMD [ARGS...]: run CMD with stdout discarded, print wall seconds
+elapsed() {
+	perl -MTime::HiRes=time -e '
+		open(my $out, ">&", \*STDOUT) or die;
+		open(STDOUT, ">", "/dev/null") or die;
+		my $t = time;
+		system(@ARGV);
+		printf $out "%.4f\n", time - $t;' "$@"
+}
+
+# best_of N CMD [ARGS...]: fastest of N elapsed() runs
+best_of() {
+	_reps=$1; shift
+	_best=
+	while [ "$_reps" -gt 0 ]; do
+		_t=$(elapsed "$@")
+		_best=$(echo "$_best $_t" | awk 'NF == 1 || $2 < $1 { print $NF; next } { print $1 }')
+		_reps=$((_reps - 1))
+	done
+	echo "$_best"
+}
+
+# gen_list DIR NDEV [NMOUNTS [NDISKS]]: replay fixture with NDEV devices spread
+# over NDISKS (default 60) disks; NMOUNTS mounts cycle over the partitions, one
+# in four is not a /dev node
+gen_list() {
+	mkdir -p "$1"
+	awk -v n="$2" -v m="${3:-0}" -v nd="${4:-60}" 'BEGIN {
+		disks = n < nd ? n : nd
+		per = int((n - disks) / disks)
+		for (i = 0; i < m; i++) {
+			if (i % 4 == 3 || per < 1)
+				printf "map auto_%d\n/System/Volumes/Data/mnt%d\nautofs\n", i, i
+			else
+				printf "/dev/disk%ds%d\n/Volumes/mnt%d\napfs\n", i % disks, 1 + int(i / disks) % per, i
+		}
+	}' | tr '\n' '\0' > "$1/mounts"
+	awk -v n="$2" -v nd="${4:-60}" 'BEGIN {
+		print "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+		print "<plist version=\"1.0\">"
+		print "<dict><key>AllDisksAndPartitions</key><array>"
+		disks = n < nd ? n : nd
+		per = int((n - disks) / disks)
+		extra = (n - disks) - per * disks
+		for (d = 0; d < disks; d++) {
+			print "<dict><key>Content</key><string>GUID_partition_scheme</string>"
+			printf "<key>DeviceIdentifier</key><string>disk%d</string><key>Partitions</key><array>\n", d
+			np = per + (d < extra ? 1 : 0)
+			for (s = 1; s <= np; s++)
+				printf "<dict><key>Content</key><string>Apple_HFS</string><key>DeviceIdentifier</key><string>disk%ds%d</string><key>Size</key><integer>%d</integer></dict>\n", d, s, s * 1048576
+			print "</array><key>Size</key><integer>1099511627776</integer></dict>"
+		}
+		print "</array></dict></plist>"
+	}' > "$1/list.plist"
+}
+
+# peak_kb CMD [ARGS...]: run CMD with stdout discarded, print its peak RSS in KiB
+peak_kb() {
+	python3 -c '
+import resource, subprocess, sys
+subprocess.run(sys.argv[1:], stdout=subprocess.DEVNULL)
+rss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+print(rss // 1024 if sys.platform == "darwin" else rss)' "$@"
+}
+
+# measure N CMD [ARGS...]: run CMD N times with stdout discarded; print the
+# median and p99 wall seconds and the largest peak RSS in KiB
+measure() {
+	python3 -c '
+import os, sys, time
+n, cmd = int(sys.argv[1]), sys.argv[2:]
+times, rss = [], 0
+for _ in range(n):
+	t = time.perf_counter()
+	pid = os.posix_spawnp(cmd[0], cmd, os.environ,
+		file_actions=[(os.POSIX_SPAWN_OPEN, 1, os.devnull, os.O_WRONLY, 0)])
+	_, status, ru = os.wait4(pid, 0)
+	times.append(time.perf_counter() - t)
+	if status:
+		sys.exit("measure: %s exited with status %d" % (cmd[0], status))
+	rss = max(rss, ru.ru_maxrss // 1024 if sys.platform == "darwin" else ru.ru_maxrss)
+times.sort()
+print("%.4f %.4f %d" % (times[n // 2], times[-(-99 * n // 100) - 1], rss))' "$@"
+}
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Mount join cost: replay a listing of 20k devices with 5k mounts, and one
+# device mounted 24k times (peak RSS must stay flat in the mount count).
+#   usage: bench/mount-join.sh [mlsblk-binary [baseline-binary]]
+# Pass a build of an older revision as baseline-binary to compare.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+tmp=${TMPDIR:-/tmp}/mlsblk-mount-join.$$
+trap 'rm -rf "$tmp"' EXIT
+
+gen_list "$tmp/mounts" 20000 5000
+gen_list "$tmp/nomounts" 20000 0
+gen_list "$tmp/one" 2 32000 1
+for b in "$bin" ${2:+"$2"}; do
+	with=$(best_of 5 "$b" --replay "$tmp/mounts" -l -o NAME,MOUNTPOINT)
+	without=$(best_of 5 "$b" --replay "$tmp/nomounts" -l -o NAME,MOUNTPOINT)
+	printf '%s: %ss with 5000 mounts, %ss without (join %ss)\n' "$b" "$with" "$without" \
+		"$(echo "$with $without" | awk '{ printf "%.4f", $1 - $2 }')"
+done
+for b in "$bin" ${2:+"$2"}; do
+	printf '%s: %ss and %s KiB peak RSS with 24000 mounts of one device\n' "$b" \
+		"$(best_of 3 "$b" --replay "$tmp/one" -l -o NAME,MOUNTPOINT)" \
+		"$(peak_kb "$b" --replay "$tmp/one" -l -o NAME,MOUNTPOINT)"
+done
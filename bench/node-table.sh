@@ -0,0 +1,20 @@
+#!/bin/sh
+# Print-path cost of the node layout: replay 1M devices and time the list,
+# tree and JSON printers, with peak RSS.
+#   usage: bench/node-table.sh [mlsblk-binary [baseline-binary]]
+# Pass a build of an older revision as baseline-binary to compare layouts.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+tmp=${TMPDIR:-/tmp}/mlsblk-node-table.$$
+trap 'rm -rf "$tmp"' EXIT
+
+gen_list "$tmp" 1000000 100000
+for b in "$bin" ${2:+"$2"}; do
+	printf '%s:\n' "$b"
+	for fmt in -l "" -J; do
+		printf '  %-3s %ss  %s KiB peak\n' "${fmt:-tree}" \
+			"$(best_of 3 "$b" --replay "$tmp" $fmt)" "$(peak_kb "$b" --replay "$tmp" $fmt)"
+	done
+done
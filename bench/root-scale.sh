@@ -0,0 +1,28 @@
+#!/bin/sh
+# Many whole disks: replay 10k disks with one partition each and check that
+# every disk and partition is printed, in tree, list and JSON form.
+#   usage: bench/root-scale.sh [mlsblk-binary]
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+bin=${1:-$dir/../mlsblk}
+tmp=${TMPDIR:-/tmp}/mlsblk-root-scale.$$
+trap 'rm -rf "$tmp"' EXIT
+
+roots=10000
+gen_list "$tmp" $((roots * 2)) 0 $roots
+fail=0
+check() {
+	if [ "$2" -ne "$3" ]; then
+		printf 'FAIL %s: %d, expected %d\n' "$1" "$2" "$3"
+		fail=1
+	fi
+}
+check "tree roots" "$("$bin" --replay "$tmp" -o NAME | grep -c '^disk')" $roots
+check "tree parts" "$("$bin" --replay "$tmp" -o NAME | grep -c '── disk')" $roots
+check "list rows" "$("$bin" --replay "$tmp" -l -o NAME | grep -c '^disk')" $((roots * 2))
+check "json disks" "$("$bin" --replay "$tmp" -J | grep -c '"type":"disk"')" $roots
+last=$("$bin" --replay "$tmp" -l -o NAME | tail -n 2 | tr '\n' ' ')
+[ "$last" = "disk$((roots - 1)) disk$((roots - 1))s1 " ] || { echo "FAIL order: $last"; fail=1; }
+printf '%d roots: %ss\n' $roots "$(best_of 3 "$bin" --replay "$tmp")"
+exit $fail
@@ -0,0 +1,92 @@
+#!/bin/sh
+# make bench: run mlsblk over recorded and synthetic fixtures and compare
+# with bench/baseline, written on this host by make bench-baseline. Per case: median and p99 wall time over the case's
+# repetitions, allocation count (bench/alloccount.so), peak RSS and peak
+# heap (from mlsblk --mem-stats).
+#   usage: bench/run.sh [--update] [mlsblk-binary]
+# --update rewrites bench/baseline from this run instead of comparing.
+# A case fails when its median is more than BENCH_TIME_TOL percent (default
+# 25, plus 5ms for noise) slower, or allocations, peak RSS or peak heap grow
+# by more than BENCH_ALLOC_TOL (5) / BENCH_RSS_TOL (20) / BENCH_HEAP_TOL (10)
+# percent. The baseline is machine specific and not checked in; without one
+# the results are only printed.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+. "$dir/lib.sh"
+update=
+[ "$1" = --update ] && { update=1; shift; }
+bin=${1:-$dir/mlsblk}
+gen=$dir/../mlsblk-gen
+shim=$dir/alloccount.so
+baseline=$dir/baseline
+tmp=${TMPDIR:-/tmp}/mlsblk-bench.$$
+trap 'rm -rf "$tmp"' EXIT
+mkdir -p "$tmp"
+
+for f in "$bin" "$gen" "$shim"; do
+	[ -e "$f" ] || { echo "bench: $f missing (run make bench)" >&2; exit 1; }
+done
+case $(uname) in
+Darwin) preload=DYLD_INSERT_LIBRARIES ;;
+*) preload=LD_PRELOAD ;;
+esac
+
+echo "preparing fixtures..." >&2
+MLSBLK_DISKUTIL=$dir/fake-diskutil FAKE_LATENCY=0 FAKE_DISKS=40 \
+	"$bin" -f --record "$tmp/recorded" > /dev/null || exit 1
+"$gen" -d 100 -p 50 -v 50 -l mixed "$tmp/gen10k" || exit 1
+"$gen" -d 1000 -p 50 -v 50 -l mixed -g 3 -S --no-info "$tmp/gen100k" || exit 1
+"$gen" -d 10000 -p 50 -v 50 -l hostile --no-info "$tmp/gen1m" || exit 1
+
+# name reps fixture args...
+cases() {
+	echo "recorded-f        30 recorded -f"
+	echo "recorded-json     30 recorded -f -J"
+	echo "gen10k-f-tree     20 gen10k -f"
+	echo "gen10k-f-csv      20 gen10k -f --csv"
+	echo "gen100k-tree      10 gen100k"
+	echo "gen100k-list      10 gen100k -l -o NAME,SIZE,MOUNTPOINTS"
+	echo "gen100k-json      10 gen100k -J -o NAME,SIZE,TYPE,MOUNTPOINTS"
+	echo "gen1m-list         5 gen1m -l"
+	echo "gen1m-ndjson       5 gen1m --ndjson"
+}
+
+# exceeds NEW BASE PERCENT [SLACK]: NEW > BASE * (1 + PERCENT/100) + SLACK
+exceeds() {
+	awk -v n="$1" -v b="$2" -v p="$3" -v s="${4:-0}" 'BEGIN { exit !(n > b * (1 + p / 100) + s) }'
+}
+
+results=$tmp/results
+printf '%-16s %9s %9s %10s %10s %10s\n' case median p99 allocs peak-KiB heap-KiB
+cases | while read -r name reps fx args; do
+	set -- $args
+	m=$(measure "$reps" "$bin" --replay "$tmp/$fx" "$@") || exit 1
+	env "$preload=$shim" ALLOCCOUNT_FILE="$tmp/allocs" "$bin" --replay "$tmp/$fx" "$@" > /dev/null
+	allocs=$(cut -d' ' -f1 "$tmp/allocs")
+	heap=$("$bin" --mem-stats --replay "$tmp/$fx" "$@" 2>&1 > /dev/null |
+		awk '$1 == "total" { print int(($6 + 1023) / 1024) }')
+	set -- $m
+	printf '%-16s %9s %9s %10s %10s %10s' "$name" "$1" "$2" "$allocs" "$3" "$heap"
+	echo "$name $1 $2 $allocs $3 $heap" >> "$results"
+	base=$(awk -v c="$name" '$1 == c' "$baseline" 2>/dev/null)
+	if [ -z "$update" ] && [ -n "$base" ]; then
+		set -- $1 $2 $allocs $3 $heap $base
+		why=
+		exceeds "$1" "$7" "${BENCH_TIME_TOL:-25}" 0.005 && why="$why time(was $7)"
+		exceeds "$3" "$9" "${BENCH_ALLOC_TOL:-5}" && why="$why allocs(was $9)"
+		exceeds "$4" "${10}" "${BENCH_RSS_TOL:-20}" && why="$why rss(was ${10})"
+		[ -n "${11}" ] && exceeds "$5" "${11}" "${BENCH_HEAP_TOL:-10}" && why="$why heap(was ${11})"
+		[ -n "$why" ] && { printf '  REGRESSION:%s' "$why"; touch "$tmp/failed"; }
+	fi
+	echo
+done || exit 1
+
+[ -z "$update" ] && [ ! -e "$baseline" ] &&
+	echo "bench: no $baseline to compare with (run make bench-baseline)" >&2
+if [ -n "$update" ]; then
+	{ echo "# case median p99 allocs peak-KiB heap-KiB (bench/run.sh --update)"; cat "$results"; } > "$baseline"
+	echo "baseline written to $baseline"
+elif [ -e "$tmp/failed" ]; then
+	echo "bench: regressions against $baseline" >&2
+	exit 1
+fi
@@ -0,0 +1,56 @@
+#!/bin/sh
+# Check device order on the Linux sysfs source: builds a small sysroot
+# (MLSBLK_SYSROOT) with sd*, sr*, vd*, nvme, loop and zram devices and
+# expects lsblk's natural name order, partitions under their disk.
+#   usage: bench/sysfs-order.sh [mlsblk-binary]
+
+dir=$(cd "$(dirname "$0")" && pwd)
+bin=${1:-$dir/../mlsblk}
+root=${TMPDIR:-/tmp}/mlsblk-sysroot.$$
+trap 'rm -rf "$root"' EXIT
+
+# dev PATH MAJ:MIN [partition]: a device under sys/devices/block, linked from sys/class/block
+dev() {
+	d=$root/sys/devices/block/$1
+	mkdir -p "$d" "$root/sys/class/block"
+	echo "$2" > "$d/dev"
+	echo 2048 > "$d/size"
+	[ -n "$3" ] && echo "$3" > "$d/partition"
+	ln -s "../../devices/block/$1" "$root/sys/class/block/$(basename "$1")"
+}
+dev zram0 252:0
+dev vda 254:0
+dev vda/vda1 254:1 1
+dev sr0 11:0
+dev sdb 8:16
+dev sda 8:0
+dev sda/sda2 8:2 2
+dev sda/sda1 8:1 1
+dev nvme0n1 259:0
+dev nvme0n1/nvme0n1p10 259:2 10
+dev nvme0n1/nvme0n1p2 259:1 2
+dev loop0 7:0
+mkdir -p "$root/proc/self"
+: > "$root/proc/self/mountinfo"
+
+want='NAME
+loop0
+nvme0n1
+nvme0n1p2
+nvme0n1p10
+sda
+sda1
+sda2
+sdb
+sr0
+vda
+vda1
+zram0'
+got=$(env -u MLSBLK_DISKUTIL MLSBLK_SYSROOT="$root" "$bin" -l -o NAME) || exit 1
+if [ "$got" != "$want" ]; then
+	echo "sysfs-order: unexpected order:" >&2
+	echo "$got" | tr '\n' ' ' >&2
+	echo >&2
+	exit 1
+fi
+echo "sysfs-order: ok"
@@ -0,0 +1,446 @@
+/*
+ * mlsblk-gen - synthetic diskutil workloads for mlsblk --replay
+ *
+ * Writes DIR/list.plist, DIR/info/<dev>.plist, DIR/apfs.plist and DIR/mounts in the format
+ * of mlsblk --record, for any number of disks, partitions and APFS volumes,
+ * so benchmarks and profiles can run at scales no real host has.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+enum Labels { LABELS_ASCII, LABELS_UTF8, LABELS_HOSTILE, LABELS_MIXED };
+static const char *label_kinds[] = { "ascii", "utf8", "hostile", "mixed" };
+
+typedef struct {
+	long disks;           /* physical disks */
+	long parts;           /* partitions per physical disk, EFI first */
+	long vols;            /* APFS volumes per container, 0 for no containers */
+	int mounted;          /* percent of partitions and volumes mounted */
+	long extra_mounts;    /* non-device entries in the mount table */
+	int labels;
+	int gaps;             /* up to this many unused disk numbers between disks */
+	bool shuffle;
+	bool info;
+	uint64_t seed;
+} Opts;
+
+/* xorshift64*: reproducible for a given --seed */
+static uint64_t rng_state;
+
+static uint64_t rnd(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ull;
+}
+
+static uint64_t rnd_below(uint64_t n) {
+	return n ? rnd() % n : 0;
+}
+
+/* One entry of AllDisksAndPartitions: a physical disk or an APFS container */
+typedef struct {
+	long num;             /* N of diskN */
+	long phys;            /* index of the physical disk it belongs to */
+	bool container;
+	uint64_t size;
+} Entry;
+
+/* plist <string> text: XML-escaped, control characters as character references */
+static void put_xml(FILE *f, const char *s) {
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '&') fputs("&amp;", f);
+		else if (c == '<') fputs("&lt;", f);
+		else if (c == '>') fputs("&gt;", f);
+		else if (c < 0x20 && c != '\t' && c != '\n') fprintf(f, "&#%d;", c);
+		else fputc(c, f);
+	}
+}
+
+static void put_key_str(FILE *f, const char *key, const char *val) {
+	fprintf(f, "<key>%s</key><string>", key);
+	put_xml(f, val);
+	fputs("</string>", f);
+}
+
+static void make_uuid(char *buf) {
+	uint64_t a = rnd(), b = rnd();
+	snprintf(buf, 37, "%08" PRIX64 "-%04" PRIX64 "-%04" PRIX64 "-%04" PRIX64 "-%012" PRIX64,
+		a >> 32, (a >> 16) & 0xffff, (a & 0x0fff) | 0x4000, (b >> 48 & 0x3fff) | 0x8000, b & (uint64_t)0xffffffffffff);
+}
+
+/* Volume name drawn from the --labels distribution */
+static void make_label(char *buf, size_t sz, int kind, long n) {
+	static const char *ascii[] = { "Macintosh HD", "Data", "Backup %ld", "Volume %ld", "Untitled %ld", "TM %ld" };
+	static const char *utf8[] = { "Données %ld", "写真 %ld", "Ñandú %ld", "Ämter 🍎 %ld", "Резерв %ld", "बैकअप %ld" };
+	static const char *hostile[] = {
+		"Vol \"%ld\" <&> \\", "tab\there %ld", "nl\nin name %ld", "ctl\001\002\037 %ld",
+		"  lead and trail %ld  ", "comma,semi;colon %ld", "$HOME `id` %ld",
+		"long %ld xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx",
+	};
+	if (kind == LABELS_MIXED) kind = (int)rnd_below(3);
+	const char *fmt;
+	switch (kind) {
+	case LABELS_UTF8: fmt = utf8[rnd_below(sizeof(utf8) / sizeof(*utf8))]; break;
+	case LABELS_HOSTILE: fmt = hostile[rnd_below(sizeof(hostile) / sizeof(*hostile))]; break;
+	default: fmt = ascii[rnd_below(sizeof(ascii) / sizeof(*ascii))]; break;
+	}
+	snprintf(buf, sz, fmt, n);
+}
+
+/* Mount point for a label: /Volumes/<label> with '/' replaced, like diskarbitrationd */
+static void make_mountpoint(char *buf, size_t sz, const char *label, const char *dev) {
+	int n = snprintf(buf, sz, "/Volumes/%s", label[0] ? label : dev);
+	for (int i = 9; i < n && (size_t)i < sz; i++)
+		if (buf[i] == '/') buf[i] = ':';
+}
+
+static FILE *open_out(const char *dir, const char *rel) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s", dir, rel);
+	FILE *f = fopen(path, "w");
+	if (!f) fprintf(stderr, "mlsblk-gen: cannot create %s: %s\n", path, strerror(errno));
+	return f;
+}
+
+static void mount_entry(FILE *f, const char *from, const char *on, const char *fstype) {
+	fputs(from, f); fputc('\0', f);
+	fputs(on, f); fputc('\0', f);
+	fputs(fstype, f); fputc('\0', f);
+}
+
+typedef struct {
+	const char *dev;
+	const char *content;
+	const char *fstype;   /* NULL: no filesystem */
+	const char *label;
+	const char *mount;    /* NULL: not mounted */
+	const char *uuid;
+	uint64_t size;
+	uint64_t used;        /* APFS volumes: CapacityInUse */
+	bool whole;
+} Dev;
+
+/* info/<dev>.plist: what diskutil info -plist reports, with some of its filler keys */
+static int write_info(const char *dir, const Dev *d) {
+	char rel[256];
+	snprintf(rel, sizeof(rel), "info/%s.plist", d->dev);
+	FILE *f = open_out(dir, rel);
+	if (!f) return -1;
+	fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+		"<plist version=\"1.0\">\n<dict>\n", f);
+	fputs("<key>Bootable</key><false/><key>BusProtocol</key><string>PCI-Express</string>", f);
+	put_key_str(f, "Content", d->content);
+	put_key_str(f, "DeviceIdentifier", d->dev);
+	fprintf(f, "<key>DeviceNode</key><string>/dev/%s</string>", d->dev);
+	if (d->fstype) put_key_str(f, "FilesystemType", d->fstype);
+	fprintf(f, "<key>Internal</key><true/><key>MediaName</key><string>%s</string>",
+		d->whole ? "APPLE SSD AP0512Q" : "");
+	if (d->mount) put_key_str(f, "MountPoint", d->mount);
+	fprintf(f, "<key>Size</key><integer>%" PRIu64 "</integer>", d->size);
+	if (d->fstype) {
+		put_key_str(f, "VolumeName", d->label);
+		put_key_str(f, "VolumeUUID", d->uuid);
+	} else {
+		put_key_str(f, "DiskUUID", d->uuid);
+	}
+	fprintf(f, "<key>WholeDisk</key><%s/>\n</dict>\n</plist>\n", d->whole ? "true" : "false");
+	return fclose(f) == 0 ? 0 : -1;
+}
+
+/* A partition or volume: its list.plist dict, info plist and mount table entry */
+static int emit_dev(const Opts *o, const char *dir, FILE *list, FILE *mounts, const Dev *d, bool volume) {
+	fputs("<dict>", list);
+	if (!volume) put_key_str(list, "Content", d->content);
+	put_key_str(list, "DeviceIdentifier", d->dev);
+	if (d->fstype && !volume) put_key_str(list, "DiskUUID", d->uuid);
+	if (d->mount) put_key_str(list, "MountPoint", d->mount);
+	fprintf(list, "<key>Size</key><integer>%" PRIu64 "</integer>", d->size);
+	if (d->fstype) {
+		put_key_str(list, "VolumeName", d->label);
+		put_key_str(list, "VolumeUUID", d->uuid);
+	}
+	if (volume) fprintf(list, "<key>CapacityInUse</key><integer>%" PRIu64 "</integer>", d->used);
+	fputs("</dict>\n", list);
+	if (d->mount) {
+		char from[64];
+		snprintf(from, sizeof(from), "/dev/%s", d->dev);
+		mount_entry(mounts, from, d->mount, d->fstype);
+	}
+	return o->info ? write_info(dir, d) : 0;
+}
+
+/* One volume of diskutil apfs list -plist; roles follow a fresh macOS install */
+static void emit_apfs_volume(FILE *apfs, const Dev *d, long v) {
+	static const char *roles[] = { "System", "Data", "Preboot", "Recovery", "VM" };
+	fputs("<dict>", apfs);
+	put_key_str(apfs, "APFSVolumeUUID", d->uuid);
+	fprintf(apfs, "<key>CapacityInUse</key><integer>%" PRIu64 "</integer>", d->used);
+	put_key_str(apfs, "DeviceIdentifier", d->dev);
+	fprintf(apfs, "<key>Encryption</key><%s/><key>FileVault</key><false/><key>Locked</key><false/>",
+		v == 2 ? "true" : "false");
+	put_key_str(apfs, "Name", d->label);
+	fputs("<key>Roles</key><array>", apfs);
+	if (v <= 5) fprintf(apfs, "<string>%s</string>", roles[v - 1]);
+	fputs("</array></dict>\n", apfs);
+}
+
+/* apfs may be NULL (--no-info) */
+static int emit_entry(const Opts *o, const char *dir, FILE *list, FILE *mounts, FILE *apfs, const Entry *e, const Entry *all) {
+	char dev[64], uuid[37], label[256], mount[300];
+	Dev d = { .dev = dev, .uuid = uuid, .label = label };
+	long n = e->num;
+	int rc = 0;
+
+	if (e->container) {
+		fputs("<dict><key>APFSPhysicalStores</key><array><dict><key>DeviceIdentifier</key>", list);
+		fprintf(list, "<string>disk%lds%ld</string></dict></array><key>APFSVolumes</key><array>\n",
+			all[e->phys * 2].num, o->parts);
+		if (apfs) {
+			uint64_t avail = e->size / 3;
+			fprintf(apfs, "<dict><key>APFSContainerUUID</key><string>%08lX-0000-4000-8000-%012lX</string>", n, n);
+			fprintf(apfs, "<key>CapacityCeiling</key><integer>%" PRIu64 "</integer><key>CapacityFree</key>"
+				"<integer>%" PRIu64 "</integer>", e->size, avail);
+			fprintf(apfs, "<key>ContainerReference</key><string>disk%ld</string><key>PhysicalStores</key><array>"
+				"<dict><key>DeviceIdentifier</key><string>disk%lds%ld</string>"
+				"<key>Size</key><integer>%" PRIu64 "</integer></dict></array><key>Volumes</key><array>\n",
+				n, all[e->phys * 2].num, o->parts, e->size);
+		}
+		for (long v = 1; v <= o->vols && !rc; v++) {
+			snprintf(dev, sizeof(dev), "disk%lds%ld", n, v);
+			make_uuid(uuid);
+			make_label(label, sizeof(label), o->labels, n * 100 + v);
+			bool mounted = rnd_below(100) < (uint64_t)o->mounted;
+			if (mounted) make_mountpoint(mount, sizeof(mount), label, dev);
+			d.content = "41504653-0000-11AA-AA11-00306543ECAC";
+			d.fstype = "apfs";
+			d.mount = mounted ? mount : NULL;
+			d.size = e->size;
+			d.used = rnd_below(d.size);
+			rc = emit_dev(o, dir, list, mounts, &d, true);
+			if (apfs) emit_apfs_volume(apfs, &d, v);
+		}
+		if (apfs) fputs("</array></dict>\n", apfs);
+		fprintf(list, "</array><key>Content</key><string>Apple_APFS_Container</string>"
+			"<key>DeviceIdentifier</key><string>disk%ld</string>"
+			"<key>Size</key><integer>%" PRIu64 "</integer></dict>\n", n, e->size);
+	} else {
+		static const struct { const char *content, *fstype; } kinds[] = {
+			{ "Apple_HFS", "hfs" }, { "Microsoft Basic Data", "exfat" }, { "Microsoft Basic Data", "ntfs" },
+		};
+		fprintf(list, "<dict><key>Content</key><string>GUID_partition_scheme</string>"
+			"<key>DeviceIdentifier</key><string>disk%ld</string><key>OSInternal</key><false/>"
+			"<key>Partitions</key><array>\n", n);
+		uint64_t efi = 209715200, rest = e->size > efi * 2 ? e->size - efi : e->size;
+		uint64_t each = o->parts > 1 ? rest / (uint64_t)(o->parts - 1) : 0;
+		for (long p = 1; p <= o->parts && !rc; p++) {
+			snprintf(dev, sizeof(dev), "disk%lds%ld", n, p);
+			make_uuid(uuid);
+			d.mount = NULL;
+			if (p == 1) {
+				d.content = "EFI";
+				d.fstype = "msdos";
+				d.size = efi;
+				snprintf(label, sizeof(label), "EFI");
+			} else if (p == o->parts && o->vols) {
+				d.content = "Apple_APFS";
+				d.fstype = NULL;
+				d.size = each;
+				label[0] = '\0';
+			} else {
+				int k = (int)rnd_below(3);
+				d.content = kinds[k].content;
+				d.fstype = kinds[k].fstype;
+				d.size = each;
+				make_label(label, sizeof(label), o->labels, n * 100 + p);
+				if (rnd_below(100) < (uint64_t)o->mounted) {
+					make_mountpoint(mount, sizeof(mount), label, dev);
+					d.mount = mount;
+				}
+			}
+			rc = emit_dev(o, dir, list, mounts, &d, false);
+		}
+		fprintf(list, "</array><key>Size</key><integer>%" PRIu64 "</integer></dict>\n", e->size);
+		if (o->info && !rc) {
+			snprintf(dev, sizeof(dev), "disk%ld", n);
+			make_uuid(uuid);
+			Dev w = { .dev = dev, .content = "GUID_partition_scheme", .uuid = uuid, .size = e->size, .whole = true };
+			rc = write_info(dir, &w);
+		}
+	}
+	return rc;
+}
+
+static int generate(const Opts *o, const char *dir) {
+	static const uint64_t sizes[] = { 121332826112ull, 251000193024ull, 500277790720ull,
+		1000555581440ull, 2000398934016ull, 4000787030016ull };
+	long nent = o->disks * (o->vols ? 2 : 1);
+	Entry *ents = calloc((size_t)nent, sizeof(Entry));
+	long *order = malloc((size_t)nent * sizeof(long));
+	if (!ents || !order) { free(ents); free(order); fprintf(stderr, "mlsblk-gen: out of memory\n"); return -1; }
+
+	/* Numbering: each physical disk, then its container, with optional gaps */
+	long num = 0;
+	for (long i = 0; i < o->disks; i++) {
+		Entry *p = &ents[i * (o->vols ? 2 : 1)];
+		p->num = num++;
+		p->phys = i;
+		p->size = sizes[rnd_below(sizeof(sizes) / sizeof(*sizes))];
+		if (o->vols) {
+			p[1] = (Entry){ .num = num++, .phys = i, .container = true, .size = p->size - 209715200 };
+		}
+		num += (long)rnd_below((uint64_t)o->gaps + 1);
+	}
+	for (long i = 0; i < nent; i++) order[i] = i;
+	if (o->shuffle)
+		for (long i = nent - 1; i > 0; i--) {
+			long j = (long)rnd_below((uint64_t)i + 1), t = order[i];
+			order[i] = order[j];
+			order[j] = t;
+		}
+
+	char info[4096];
+	snprintf(info, sizeof(info), "%s/info", dir);
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "mlsblk-gen: cannot create %s: %s\n", dir, strerror(errno));
+		free(ents); free(order);
+		return -1;
+	}
+	if (o->info && mkdir(info, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "mlsblk-gen: cannot create %s: %s\n", info, strerror(errno));
+		free(ents); free(order);
+		return -1;
+	}
+	FILE *list = open_out(dir, "list.plist"), *mounts = open_out(dir, "mounts");
+	FILE *apfs = o->info ? open_out(dir, "apfs.plist") : NULL;
+	int rc = list && mounts && (apfs || !o->info) ? 0 : -1;
+	if (!rc) {
+		static char lbuf[1 << 16];
+		setvbuf(list, lbuf, _IOFBF, sizeof(lbuf));
+		fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			"<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+			"<plist version=\"1.0\">\n<dict>\n<key>AllDisks</key><array>\n", list);
+		for (long i = 0; i < nent; i++)
+			fprintf(list, "<string>disk%ld</string>\n", ents[order[i]].num);
+		fputs("</array>\n<key>AllDisksAndPartitions</key><array>\n", list);
+		mount_entry(mounts, "devfs", "/dev", "devfs");
+		if (apfs)
+			fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n<dict>\n"
+				"<key>Containers</key><array>\n", apfs);
+		for (long i = 0; i < nent && !rc; i++)
+			rc = emit_entry(o, dir, list, mounts, apfs, &ents[order[i]], ents);
+		if (apfs) fputs("</array>\n</dict>\n</plist>\n", apfs);
+		fputs("</array>\n<key>WholeDisks</key><array>\n", list);
+		for (long i = 0; i < nent; i++)
+			fprintf(list, "<string>disk%ld</string>\n", ents[order[i]].num);
+		fputs("</array>\n</dict>\n</plist>\n", list);
+		for (long i = 0; i < o->extra_mounts; i++) {
+			char from[64], on[64];
+			if (i % 2) {
+				snprintf(from, sizeof(from), "map auto_%ld", i);
+				snprintf(on, sizeof(on), "/System/Volumes/Data/auto%ld", i);
+				mount_entry(mounts, from, on, "autofs");
+			} else {
+				snprintf(from, sizeof(from), "fileserver:/export/%ld", i);
+				snprintf(on, sizeof(on), "/Volumes/nfs%ld", i);
+				mount_entry(mounts, from, on, "nfs");
+			}
+		}
+	}
+	if (list && fclose(list) != 0) rc = -1;
+	if (mounts && fclose(mounts) != 0) rc = -1;
+	if (apfs && fclose(apfs) != 0) rc = -1;
+	if (rc) fprintf(stderr, "mlsblk-gen: failed writing %s\n", dir);
+	free(ents);
+	free(order);
+	return rc;
+}
+
+static void usage(void) {
+	fprintf(stderr, "Usage: mlsblk-gen [options] DIR\n");
+	fprintf(stderr, "  -d, --disks N         physical disks (default 4)\n");
+	fprintf(stderr, "  -p, --partitions N    partitions per disk, EFI first (default 3)\n");
+	fprintf(stderr, "  -v, --volumes N       APFS volumes per container; with N > 0 each disk's last\n");
+	fprintf(stderr, "                        partition is the store of one container (default 5)\n");
+	fprintf(stderr, "  -m, --mounted PCT     percent of partitions and volumes mounted (default 60)\n");
+	fprintf(stderr, "  -x, --extra-mounts N  autofs/nfs entries in the mount table (default 4)\n");
+	fprintf(stderr, "  -l, --labels KIND     ascii, utf8, hostile or mixed (default ascii)\n");
+	fprintf(stderr, "  -g, --gaps N          up to N unused disk numbers between disks (default 0)\n");
+	fprintf(stderr, "  -S, --shuffle         list disks in random order instead of sorted\n");
+	fprintf(stderr, "  -s, --seed N          random seed (default 1)\n");
+	fprintf(stderr, "      --no-info         do not write info/*.plist or apfs.plist (for runs without -f)\n");
+	fprintf(stderr, "Writes DIR/list.plist, DIR/info/, DIR/apfs.plist and DIR/mounts for mlsblk --replay DIR.\n");
+}
+
+static bool parse_count(const char *s, long max, long *out) {
+	char *end;
+	errno = 0;
+	long v = strtol(s, &end, 10);
+	if (errno || *end || v < 0 || v > max) return false;
+	*out = v;
+	return true;
+}
+
+int main(int argc, char **argv) {
+	Opts o = { .disks = 4, .parts = 3, .vols = 5, .mounted = 60, .extra_mounts = 4, .info = true, .seed = 1 };
+	enum { OPT_NO_INFO = 256 };
+	static const struct option longopts[] = {
+		{ "disks", required_argument, NULL, 'd' },
+		{ "partitions", required_argument, NULL, 'p' },
+		{ "volumes", required_argument, NULL, 'v' },
+		{ "mounted", required_argument, NULL, 'm' },
+		{ "extra-mounts", required_argument, NULL, 'x' },
+		{ "labels", required_argument, NULL, 'l' },
+		{ "gaps", required_argument, NULL, 'g' },
+		{ "shuffle", no_argument, NULL, 'S' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "no-info", no_argument, NULL, OPT_NO_INFO },
+		{ NULL, 0, NULL, 0 }
+	};
+	int ch;
+	long v;
+	while ((ch = getopt_long(argc, argv, "d:p:v:m:x:l:g:Ss:", longopts, NULL)) != -1) {
+		bool ok = true;
+		switch (ch) {
+		case 'd': ok = parse_count(optarg, 1000000, &o.disks); break;
+		case 'p': ok = parse_count(optarg, 100000, &o.parts) && o.parts >= 1; break;
+		case 'v': ok = parse_count(optarg, 100000, &o.vols); break;
+		case 'm': ok = parse_count(optarg, 100, &v); o.mounted = (int)v; break;
+		case 'x': ok = parse_count(optarg, 10000000, &o.extra_mounts); break;
+		case 'g': ok = parse_count(optarg, 1000, &v); o.gaps = (int)v; break;
+		case 'S': o.shuffle = true; break;
+		case 's': ok = parse_count(optarg, LONG_MAX, &v); o.seed = (uint64_t)v; break;
+		case 'l':
+			ok = false;
+			for (int k = 0; k < 4; k++)
+				if (strcmp(optarg, label_kinds[k]) == 0) { o.labels = k; ok = true; }
+			break;
+		case OPT_NO_INFO: o.info = false; break;
+		default: usage(); return 1;
+		}
+		if (!ok) {
+			fprintf(stderr, "mlsblk-gen: invalid value for -%c: %s\n", ch, optarg);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return 1;
+	}
+	if (o.vols && o.parts < 2) {
+		fprintf(stderr, "mlsblk-gen: APFS volumes need at least 2 partitions per disk\n");
+		return 1;
+	}
+	rng_state = o.seed * 0x9e3779b97f4a7c15ull + 1;
+	return generate(&o, argv[optind]) == 0 ? 0 : 1;
+}
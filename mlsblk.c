@@ -1,35 +1,261 @@
 /*
  * mlsblk - list block devices (macOS port of lsblk)
- * Data: diskutil list -plist, getmntinfo(), diskutil info -plist (for -f)
+ * Data: diskutil list -plist, getmntinfo(), diskutil info -plist (for -f),
+ * served live, recorded to a directory (--record) or replayed from one (--replay)
  */
 
 #define _DARWIN_C_SOURCE
+#define _GNU_SOURCE
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
+#include <poll.h>
+#include <spawn.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mount.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
-#include <CoreFoundation/CoreFoundation.h>
+#ifdef __APPLE__
+#include <sys/mount.h>
+#endif
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 /* Default columns when no -o */
 #define DEFAULT_COLS "NAME,SIZE,TYPE,MOUNTPOINT"
 
+/* Upper bound for concurrent diskutil info children (--jobs) */
+#define MAX_JOBS 64
+
+extern char **environ;
+
+/* FNV-1a */
+static uint32_t hash_bytes(const char *s, size_t len) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+	return h;
+}
+
+static uint32_t name_hash(const char *s) {
+	return hash_bytes(s, strlen(s));
+}
+
+/* Pipeline phases, as measured by --timing, --perf-counters and --mem-stats */
+enum Phase { PH_LIST, PH_PARSE, PH_SORT, PH_MOUNTS, PH_JOIN, PH_APFS, PH_INFO, PH_INFO_PARSE, PH_FREEZE, PH_OUTPUT, PH_MAX };
+static const char *phase_names[] = { "list", "parse", "sort", "mounts", "join", "apfs", "info", "info-parse", "freeze", "output" };
+static const bool phase_nested[PH_MAX] = { [PH_PARSE] = true, [PH_INFO_PARSE] = true };
+
+/*
+ * All heap use goes through these wrappers. With --mem-stats they count
+ * allocations, reallocs, frees and bytes against the current phase and track
+ * live and peak heap (usable sizes, from the allocator); otherwise they are
+ * one branch on top of libc. Index PH_MAX collects work outside any phase.
+ */
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#define heap_size(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define heap_size(p) malloc_usable_size(p)
+#endif
+
+typedef struct {
+	uint64_t allocs, reallocs, frees, bytes;
+	int64_t peak;         /* highest live heap seen during the phase */
+} MemStat;
+
+static struct {
+	bool on;
+	int cur;              /* phase allocations are charged to */
+	int prev[PH_MAX];     /* enclosing phase, restored at phase end */
+	int64_t live, peak;
+	MemStat ph[PH_MAX + 1];
+} mem = { .cur = PH_MAX };
+
+static void mem_live(int64_t delta) {
+	mem.live += delta;
+	if (mem.live > mem.peak) mem.peak = mem.live;
+	if (mem.live > mem.ph[mem.cur].peak) mem.ph[mem.cur].peak = mem.live;
+}
+
+static void *mem_malloc(size_t n) {
+	void *p = malloc(n);
+	if (mem.on && p) {
+		mem.ph[mem.cur].allocs++;
+		mem.ph[mem.cur].bytes += n;
+		mem_live((int64_t)heap_size(p));
+	}
+	return p;
+}
+
+static void *mem_calloc(size_t n, size_t size) {
+	void *p = calloc(n, size);
+	if (mem.on && p) {
+		mem.ph[mem.cur].allocs++;
+		mem.ph[mem.cur].bytes += n * size;
+		mem_live((int64_t)heap_size(p));
+	}
+	return p;
+}
+
+static void *mem_realloc(void *old, size_t n) {
+	if (!mem.on) return realloc(old, n);
+	int64_t before = old ? (int64_t)heap_size(old) : 0;
+	void *p = realloc(old, n);
+	if (!p) return NULL;
+	if (old) mem.ph[mem.cur].reallocs++;
+	else mem.ph[mem.cur].allocs++;
+	mem.ph[mem.cur].bytes += n;
+	mem_live((int64_t)heap_size(p) - before);
+	return p;
+}
+
+static void mem_free(void *p) {
+	if (mem.on && p) {
+		mem.ph[mem.cur].frees++;
+		mem_live(-(int64_t)heap_size(p));
+	}
+	free(p);
+}
+
+static char *mem_strdup(const char *s) {
+	size_t n = strlen(s) + 1;
+	char *p = mem_malloc(n);
+	if (p) memcpy(p, s, n);
+	return p;
+}
+
+/*
+ * Bump arena for nodes and their strings; nothing is freed individually,
+ * arena_release() drops everything at once. arena_intern() returns one
+ * shared copy per distinct value (types, fstypes, ...).
+ */
+#define ARENA_BLOCK 65536
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock {
+	ArenaBlock *next;
+	size_t used, cap;
+	max_align_t data[];
+};
+
+typedef struct {
+	ArenaBlock *head;
+	const char **interned;   /* open-addressing set, NULL if empty slot */
+	uint32_t imask, nint;
+} Arena;
+
+static void *arena_alloc(Arena *a, size_t size) {
+	size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+	ArenaBlock *b = a->head;
+	if (!b || b->cap - b->used < size) {
+		size_t cap = size > ARENA_BLOCK / 4 ? size : ARENA_BLOCK;
+		b = mem_malloc(sizeof(ArenaBlock) + cap);
+		if (!b) return NULL;
+		b->used = 0;
+		b->cap = cap;
+		/* An oversized request gets its own block behind the current one */
+		if (cap != ARENA_BLOCK && a->head) { b->next = a->head->next; a->head->next = b; }
+		else { b->next = a->head; a->head = b; }
+	}
+	void *p = (char *)b->data + b->used;
+	b->used += size;
+	return memset(p, 0, size);
+}
+
+static char *arena_strndup(Arena *a, const char *s, size_t len) {
+	char *p = arena_alloc(a, len + 1);
+	if (!p) return NULL;
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+static const char *arena_intern(Arena *a, const char *s, size_t len) {
+	if (!len) return "";
+	if ((a->nint + 1) * 2 > (a->interned ? a->imask + 1 : 0)) {
+		uint32_t nslots = a->interned ? (a->imask + 1) * 2 : 32;
+		const char **slots = mem_calloc(nslots, sizeof(char *));
+		if (!slots) return arena_strndup(a, s, len);
+		for (uint32_t i = 0; a->interned && i <= a->imask; i++) {
+			if (!a->interned[i]) continue;
+			uint32_t j = name_hash(a->interned[i]) & (nslots - 1);
+			while (slots[j]) j = (j + 1) & (nslots - 1);
+			slots[j] = a->interned[i];
+		}
+		mem_free(a->interned);
+		a->interned = slots;
+		a->imask = nslots - 1;
+	}
+	uint32_t i = hash_bytes(s, len) & a->imask;
+	for (; a->interned[i]; i = (i + 1) & a->imask)
+		if (strncmp(a->interned[i], s, len) == 0 && a->interned[i][len] == '\0')
+			return a->interned[i];
+	char *p = arena_strndup(a, s, len);
+	if (p) {
+		a->interned[i] = p;
+		a->nint++;
+	}
+	return p;
+}
+
+static void arena_release(Arena *a) {
+	for (ArenaBlock *b = a->head, *next; b; b = next) {
+		next = b->next;
+		mem_free(b);
+	}
+	mem_free(a->interned);
+	*a = (Arena){ 0 };
+}
+
+/*
+ * Fields a data source can settle (Node.known) and that columns need (Plan).
+ * K_MOUNT is only planned, never recorded per node.
+ */
+enum { K_FSTYPE = 1, K_LABEL = 2, K_UUID = 4, K_APFS = 8, K_MOUNT = 16 };
+#define K_INFO (K_FSTYPE | K_LABEL | K_UUID)
+
 typedef struct Node Node;
 struct Node {
-	char *name;           /* disk0, disk0s1, ... */
+	const char *name;     /* disk0, disk0s1, ... */
 	uint64_t size;        /* bytes */
-	char *type;           /* "disk" or "part" */
-	char *mountpoint;     /* path or "" */
-	char *fstype;         /* apfs, hfs, etc */
-	char *label;          /* volume name */
-	char *uuid;           /* UUID string */
+	const char *type;     /* "disk" or "part" (interned) */
+	const char *mountpoint; /* path or "" */
+	const char **mounts;  /* every mount of the device, in mount table order */
+	int nmounts;
+	int cap_mounts;
+	const char *fstype;   /* apfs, hfs, etc (interned) */
+	const char *label;    /* volume name */
+	const char *uuid;     /* UUID string */
+	const char *role;     /* APFS volume roles, comma-separated (interned) */
+	const char *encrypted; /* "yes", "no" or "" (interned) */
+	uint64_t fsused;      /* bytes in use, 0 if unknown */
+	uint64_t dev;         /* device number, 0 if unknown (sysfs source) */
+	uint32_t hash;        /* name_hash(name), for NodeArray's index */
+	uint8_t known;        /* K_* fields already settled; no source needs to fetch them */
+	uint64_t key;         /* sort_key(name) */
 	Node *parent;
 	Node **children;
 	int nchildren;
@@ -37,74 +263,97 @@ struct Node {
 	int index;            /* for stable sort */
 };
 
-static Node *node_create(const char *name, uint64_t size, const char *type) {
-	Node *n = calloc(1, sizeof(Node));
-	if (!n) return NULL;
-	n->name = strdup(name);
-	n->size = size;
-	n->type = strdup(type ? type : "disk");
-	n->mountpoint = strdup("");
-	n->fstype = strdup("");
-	n->label = strdup("");
-	n->uuid = strdup("");
-	n->children = NULL;
-	n->cap_children = 0;
-	return n;
-}
-
-static void node_free(Node *n) {
-	if (!n) return;
-	free(n->name);
-	free(n->type);
-	free(n->mountpoint);
-	free(n->fstype);
-	free(n->label);
-	free(n->uuid);
-	for (int i = 0; i < n->nchildren; i++)
-		node_free(n->children[i]);
-	free(n->children);
-	free(n);
-}
-
-static int node_add_child(Node *parent, Node *child) {
-	if (parent->nchildren >= parent->cap_children) {
-		int newcap = parent->cap_children ? parent->cap_children * 2 : 4;
-		Node **p = realloc(parent->children, (size_t)newcap * sizeof(Node *));
-		if (!p) return -1;
-		parent->children = p;
-		parent->cap_children = newcap;
-	}
-	child->parent = parent;
-	parent->children[parent->nchildren++] = child;
-	return 0;
-}
-
 /* Parse "disk0", "disk0s1" -> compare numerically */
 static int name_cmp(const char *a, const char *b) {
 	if (!a || !b) return 0;
 	/* skip "disk" prefix */
 	const char *pa = (strncmp(a, "disk", 4) == 0) ? a + 4 : a;
 	const char *pb = (strncmp(b, "disk", 4) == 0) ? b + 4 : b;
+	bool disk = pa != a && pb != b;   /* diskutil names: slices sort after letters */
 	while (*pa && *pb) {
-		if (*pa == *pb) { pa++; pb++; continue; }
-		if (*pa == 's' && *pb == 's') { pa++; pb++; continue; }
-		if (*pa == 's') return 1;
-		if (*pb == 's') return -1;
+		/* Whole digit runs compare as numbers (disk2 < disk10) */
 		if (*pa >= '0' && *pa <= '9' && *pb >= '0' && *pb <= '9') {
 			unsigned long na = strtoul(pa, (char **)&pa, 10);
 			unsigned long nb = strtoul(pb, (char **)&pb, 10);
 			if (na != nb) return (na > nb) - (na < nb);
 			continue;
 		}
+		if (*pa == *pb) { pa++; pb++; continue; }
+		if (disk && *pa == 's') return 1;
+		if (disk && *pb == 's') return -1;
 		return (unsigned char)*pa - (unsigned char)*pb;
 	}
 	return (unsigned char)*pa - (unsigned char)*pb;
 }
 
+/*
+ * Sort key for diskN[sM[sK]]: the numbers packed most significant first,
+ * slices stored +1 so that a missing slice sorts before slice 0. Integer
+ * order of two keys equals name_cmp() order of their names. Any other name
+ * (leading zeros, other prefixes, out-of-range numbers) gets KEY_SLOW and
+ * is compared with name_cmp().
+ */
+#define KEY_SLOW (1ull << 63)
+
+static uint64_t sort_key(const char *s) {
+	static const int shift[] = { 40, 20, 0 };
+	static const uint64_t lim[] = { 1u << 23, (1u << 20) - 1, (1u << 20) - 1 };
+	if (strncmp(s, "disk", 4) != 0) return KEY_SLOW;
+	s += 4;
+	uint64_t key = 0;
+	for (int c = 0; c < 3; c++) {
+		if (*s < '0' || *s > '9' || (s[0] == '0' && s[1] >= '0' && s[1] <= '9'))
+			return KEY_SLOW;
+		uint64_t v = 0;
+		while (*s >= '0' && *s <= '9' && v < lim[c])
+			v = v * 10 + (uint64_t)(*s++ - '0');
+		if (v >= lim[c]) return KEY_SLOW;
+		key |= (c ? v + 1 : v) << shift[c];
+		if (!*s) return key;
+		if (*s++ != 's') return KEY_SLOW;
+	}
+	return KEY_SLOW;
+}
+
+static Node *node_create(Arena *a, const char *name, uint64_t size, const char *type) {
+	Node *n = arena_alloc(a, sizeof(Node));
+	if (!n || !(n->name = arena_strndup(a, name, strlen(name)))) return NULL;
+	n->hash = name_hash(name);
+	n->key = sort_key(name);
+	n->size = size;
+	type = type ? type : "disk";
+	n->type = arena_intern(a, type, strlen(type));
+	n->mountpoint = n->fstype = n->label = n->uuid = n->role = n->encrypted = "";
+	return n;
+}
+
+/* Grow an arena array of pointers; the old copy is simply abandoned */
+static void *arena_grow(Arena *a, void *old, int n, int *cap, size_t elem) {
+	int ncap = *cap ? *cap * 2 : 4;
+	void *p = arena_alloc(a, (size_t)ncap * elem);
+	if (!p) return NULL;
+	if (n) memcpy(p, old, (size_t)n * elem);
+	*cap = ncap;
+	return p;
+}
+
+static int node_add_child(Arena *a, Node *parent, Node *child) {
+	if (parent->nchildren >= parent->cap_children) {
+		Node **p = arena_grow(a, parent->children, parent->nchildren, &parent->cap_children, sizeof(Node *));
+		if (!p) return -1;
+		parent->children = p;
+	}
+	child->parent = parent;
+	parent->children[parent->nchildren++] = child;
+	return 0;
+}
+
 static int node_cmp(const void *va, const void *vb) {
 	const Node *a = *(const Node *const *)va;
 	const Node *b = *(const Node *const *)vb;
-	return name_cmp(a->name, b->name);
+	if ((a->key | b->key) & KEY_SLOW)
+		return name_cmp(a->name, b->name);
+	return (a->key > b->key) - (a->key < b->key);
 }
 
 static void sort_children(Node *n) {
@@ -114,505 +363,3312 @@ static void sort_children(Node *n) {
 		sort_children(n->children[i]);
 }
 
-/* Human-readable size */
-static void fmt_size(uint64_t bytes, char *buf, size_t bufsz) {
-	const char *units[] = { "B", "K", "M", "G", "T", "P" };
+/*
+ * Human-readable size into buf (at least 32 bytes); returns the length.
+ * Same text as printf("%.1f%c") of bytes / 1024^u as a double, in integer
+ * math: bytes is first rounded to a double's 53 bits (m * 2^e), after which
+ * the quotient is exact in binary and the tenths round half-to-even on the
+ * remainder, as printf does.
+ */
+static int fmt_size(uint64_t bytes, char *buf) {
+	static const char units[] = "BKMGTP";
+	uint64_t m = bytes;
+	int e = 0, bits = m ? 64 - __builtin_clzll(m) : 0;
+	if (bits > 53) {
+		e = bits - 53;
+		uint64_t half = 1ull << (e - 1), rem = m & ((half << 1) - 1);
+		m >>= e;
+		if (rem > half || (rem == half && (m & 1))) m++;
+		if (m >> 53) { m >>= 1; e++; }
+		bits = 53;
+	}
 	int u = 0;
-	double v = (double)bytes;
-	while (v >= 1024 && u < 5) { v /= 1024; u++; }
-	snprintf(buf, bufsz, "%.1f%c", v, *units[u]);
-}
-
-/* Run diskutil list -plist, return CFDictionary or NULL */
-static CFDictionaryRef get_list_plist(void) {
-	FILE *fp = popen("diskutil list -plist 2>/dev/null", "r");
-	if (!fp) return NULL;
-	size_t cap = 65536, len = 0;
-	char *buf = malloc(cap);
-	if (!buf) { pclose(fp); return NULL; }
-	while (!feof(fp)) {
-		len += fread(buf + len, 1, cap - len, fp);
-		if (len >= cap - 1024) {
-			cap *= 2;
-			char *n = realloc(buf, cap);
-			if (!n) { free(buf); pclose(fp); return NULL; }
-			buf = n;
-		}
+	while (u < 5 && bits + e > 10 * (u + 1)) u++;
+	int shift = 10 * u - e;   /* e > 0 only for sizes in P */
+	uint64_t q = m >> shift, r = m & ((1ull << shift) - 1);
+	uint64_t tenths = q * 10 + ((r * 10) >> shift);
+	if (shift) {
+		uint64_t rem = (r * 10) & ((1ull << shift) - 1), half = 1ull << (shift - 1);
+		if (rem > half || (rem == half && (tenths & 1))) tenths++;
 	}
-	pclose(fp);
+	char tmp[24];
+	int n = 0, len = 0;
+	uint64_t whole = tenths / 10;
+	do tmp[n++] = (char)('0' + whole % 10); while (whole /= 10);
+	while (n) buf[len++] = tmp[--n];
+	buf[len++] = '.';
+	buf[len++] = (char)('0' + tenths % 10);
+	buf[len++] = units[u];
 	buf[len] = '\0';
+	return len;
+}
 
-	CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, (const UInt8 *)buf, (CFIndex)len, kCFAllocatorNull);
-	if (!data) { free(buf); return NULL; }
-	CFPropertyListRef plist = CFPropertyListCreateWithData(kCFAllocatorDefault, data, kCFPropertyListImmutable, NULL, NULL);
-	CFRelease(data);
-	free(buf);
-	if (!plist || CFGetTypeID(plist) != CFDictionaryGetTypeID()) {
-		if (plist) CFRelease(plist);
-		return NULL;
+/*
+ * --timing / MLSBLK_TRACE: monotonic time per phase and per diskutil info
+ * child, summarized on stderr at exit. When off, each probe is one branch.
+ * Nested phases (parse within list, info-parse within info) are included in
+ * their parent's time. --trace-file keeps every span as well and writes them
+ * as Chrome trace events: tid 0 is the main loop, tid N is info job slot N.
+ */
+
+typedef struct {
+	const char *name;     /* static string */
+	char dev[32];         /* device of an info span */
+	uint64_t ts, dur;
+	int tid, pid;
+} TraceEvent;
+
+static struct {
+	bool on;              /* any of the below */
+	bool report, json;
+	uint64_t t0;
+	uint64_t ns[PH_MAX], count[PH_MAX];
+	uint32_t *spawn_us;   /* start-to-exit latency of each info child */
+	size_t nspawn, cap;
+	const char *trace_path;
+	TraceEvent *ev;
+	size_t nev, cap_ev;
+	int ntracks;
+} timing;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * --perf-counters (Linux): user-space hardware counters of this process per
+ * phase, read at each phase boundary. diskutil children are not counted.
+ * Counters the kernel refuses (perf_event_paranoid, no PMU in a VM) read n/a.
+ */
+enum { PC_CYCLES, PC_INSTR, PC_CACHE_MISS, PC_BRANCH_MISS, PC_FAULTS, PC_MAX };
+static const char *pc_names[] = { "cycles", "instructions", "cache-misses", "branch-misses", "page-faults" };
+
+static struct {
+	bool on;
+	int fd[PC_MAX];
+	uint64_t start[PH_MAX][PC_MAX], sum[PH_MAX][PC_MAX];
+} perf;
+
+static void perf_read(uint64_t v[PC_MAX]) {
+	for (int i = 0; i < PC_MAX; i++)
+		if (perf.fd[i] < 0 || read(perf.fd[i], &v[i], sizeof(v[i])) != (ssize_t)sizeof(v[i]))
+			v[i] = 0;
+}
+
+static void perf_open(void) {
+	for (int i = 0; i < PC_MAX; i++)
+		perf.fd[i] = -1;
+#ifdef __linux__
+	static const struct { uint32_t type; uint64_t config; } ev[PC_MAX] = {
+		[PC_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		[PC_INSTR] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		[PC_CACHE_MISS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		[PC_BRANCH_MISS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		[PC_FAULTS] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+	};
+	int err = 0;
+	for (int i = 0; i < PC_MAX; i++) {
+		struct perf_event_attr a = { 0 };
+		a.size = sizeof(a);
+		a.type = ev[i].type;
+		a.config = ev[i].config;
+		a.exclude_kernel = 1;
+		a.exclude_hv = 1;
+		perf.fd[i] = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+		if (perf.fd[i] >= 0) perf.on = true;
+		else if (!err) err = errno;
 	}
-	return (CFDictionaryRef)plist;
-}
-
-/* Run diskutil info -plist <device>, return CFDictionary (caller releases) */
-static CFDictionaryRef get_info_plist(const char *device) {
-	char cmd[256];
-	snprintf(cmd, sizeof(cmd), "diskutil info -plist %s 2>/dev/null", device);
-	FILE *fp = popen(cmd, "r");
-	if (!fp) return NULL;
-	size_t cap = 32768, len = 0;
-	char *buf = malloc(cap);
-	if (!buf) { pclose(fp); return NULL; }
-	while (!feof(fp)) {
-		len += fread(buf + len, 1, cap - len, fp);
-		if (len >= cap - 1024) {
-			cap *= 2;
-			char *n = realloc(buf, cap);
-			if (!n) { free(buf); pclose(fp); return NULL; }
-			buf = n;
+	if (err)
+		fprintf(stderr, "mlsblk: some perf counters unavailable: %s%s\n", strerror(err),
+			err == EACCES || err == EPERM ? " (see /proc/sys/kernel/perf_event_paranoid)" :
+			err == ENOENT || err == EOPNOTSUPP ? " (no hardware PMU, e.g. in a VM)" : "");
+#else
+	fprintf(stderr, "mlsblk: --perf-counters is only supported on Linux\n");
+#endif
+}
+
+static void perf_report(void) {
+	if (!perf.on) return;
+	FILE *f = stderr;
+	fprintf(f, "mlsblk: perf counters (user space, this process)\n");
+	fprintf(f, "  %-12s", "phase");
+	for (int i = 0; i < PC_MAX; i++)
+		fprintf(f, " %14s", pc_names[i]);
+	fprintf(f, " %6s\n", "IPC");
+	for (int ph = 0; ph < PH_MAX; ph++) {
+		const uint64_t *v = perf.sum[ph];
+		fprintf(f, "  %s%-*s", phase_nested[ph] ? "  " : "", phase_nested[ph] ? 10 : 12, phase_names[ph]);
+		for (int i = 0; i < PC_MAX; i++) {
+			if (perf.fd[i] < 0) fprintf(f, " %14s", "n/a");
+			else fprintf(f, " %14llu", (unsigned long long)v[i]);
 		}
+		if (perf.fd[PC_CYCLES] >= 0 && perf.fd[PC_INSTR] >= 0 && v[PC_CYCLES])
+			fprintf(f, " %6.2f\n", (double)v[PC_INSTR] / (double)v[PC_CYCLES]);
+		else
+			fprintf(f, " %6s\n", "-");
 	}
-	pclose(fp);
-	buf[len] = '\0';
+	for (int i = 0; i < PC_MAX; i++)
+		if (perf.fd[i] >= 0) close(perf.fd[i]);
+}
 
-	CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, (const UInt8 *)buf, (CFIndex)len, kCFAllocatorNull);
-	if (!data) { free(buf); return NULL; }
-	CFPropertyListRef plist = CFPropertyListCreateWithData(kCFAllocatorDefault, data, kCFPropertyListImmutable, NULL, NULL);
-	CFRelease(data);
-	free(buf);
-	if (!plist || CFGetTypeID(plist) != CFDictionaryGetTypeID()) {
-		if (plist) CFRelease(plist);
-		return NULL;
+/* Per-phase heap table on stderr, with peak heap and peak RSS */
+static void mem_report(void) {
+	if (!mem.on) return;
+	FILE *f = stderr;
+	MemStat tot = { 0 };
+	fprintf(f, "mlsblk: memory (heap through mem_* wrappers)\n");
+	fprintf(f, "  %-12s %10s %10s %10s %14s %14s\n", "phase", "allocs", "reallocs", "frees", "bytes", "peak heap");
+	for (int ph = 0; ph <= PH_MAX; ph++) {
+		const MemStat *m = &mem.ph[ph];
+		bool nested = ph < PH_MAX && phase_nested[ph];
+		fprintf(f, "  %s%-*s %10llu %10llu %10llu %14llu %14lld\n", nested ? "  " : "", nested ? 10 : 12,
+			ph < PH_MAX ? phase_names[ph] : "(other)", (unsigned long long)m->allocs,
+			(unsigned long long)m->reallocs, (unsigned long long)m->frees,
+			(unsigned long long)m->bytes, (long long)m->peak);
+		tot.allocs += m->allocs;
+		tot.reallocs += m->reallocs;
+		tot.frees += m->frees;
+		tot.bytes += m->bytes;
+	}
+	fprintf(f, "  %-12s %10llu %10llu %10llu %14llu %14lld\n", "total", (unsigned long long)tot.allocs,
+		(unsigned long long)tot.reallocs, (unsigned long long)tot.frees,
+		(unsigned long long)tot.bytes, (long long)mem.peak);
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef __APPLE__
+		long kib = ru.ru_maxrss / 1024;   /* bytes on macOS */
+#else
+		long kib = ru.ru_maxrss;
+#endif
+		fprintf(f, "  peak RSS %ld KiB, heap still live at exit %lld bytes\n", kib, (long long)mem.live);
 	}
-	return (CFDictionaryRef)plist;
 }
 
-static char *cfstr(CFTypeRef ref) {
-	if (!ref || CFGetTypeID(ref) != CFStringGetTypeID()) return NULL;
-	CFStringRef s = (CFStringRef)ref;
-	CFIndex len = CFStringGetLength(s);
-	CFIndex size = CFStringGetMaximumSizeForEncoding(len, kCFStringEncodingUTF8) + 1;
-	char *buf = malloc((size_t)size);
-	if (!buf) return NULL;
-	if (!CFStringGetCString(s, buf, size, kCFStringEncodingUTF8)) { free(buf); return NULL; }
-	return buf;
+/* Timestamp for a span that is not a phase (trace only) */
+static uint64_t span_begin(void) {
+	return timing.on ? now_ns() : 0;
 }
 
-static uint64_t cfint(CFTypeRef ref) {
-	if (!ref) return 0;
-	if (CFGetTypeID(ref) == CFNumberGetTypeID()) {
-		long long val = 0;
-		CFNumberGetValue((CFNumberRef)ref, kCFNumberLongLongType, &val);
-		return (uint64_t)val;
+static uint64_t phase_begin(int ph) {
+	if (!timing.on) return 0;
+	if (mem.on) {
+		mem.prev[ph] = mem.cur;
+		mem.cur = ph;
 	}
-	return 0;
+	uint64_t t = now_ns();
+	if (perf.on) perf_read(perf.start[ph]);
+	return t;
+}
+
+static TraceEvent *trace_add(const char *name, uint64_t t, uint64_t now, int tid) {
+	if (timing.nev == timing.cap_ev) {
+		size_t cap = timing.cap_ev ? timing.cap_ev * 2 : 256;
+		TraceEvent *p = mem_realloc(timing.ev, cap * sizeof(TraceEvent));
+		if (!p) return NULL;
+		timing.ev = p;
+		timing.cap_ev = cap;
+	}
+	TraceEvent *e = &timing.ev[timing.nev++];
+	e->name = name;
+	e->dev[0] = '\0';
+	e->ts = t - timing.t0;
+	e->dur = now - t;
+	e->tid = tid;
+	e->pid = 0;
+	if (tid > timing.ntracks) timing.ntracks = tid;
+	return e;
 }
 
-/* Content string -> fstype for display */
-static void content_to_fstype(const char *content, char *out, size_t outsz) {
-	if (!content) { out[0] = '\0'; return; }
-	if (strstr(content, "APFS") || strstr(content, "41504653")) { snprintf(out, outsz, "apfs"); return; }
-	if (strstr(content, "HFS") || strstr(content, "Apple_HFS")) { snprintf(out, outsz, "hfs"); return; }
-	if (strstr(content, "EFI") || strstr(content, "C12A7328")) { snprintf(out, outsz, "vfat"); return; }
-	if (strstr(content, "GUID_partition_scheme")) { out[0] = '\0'; return; }
-	snprintf(out, outsz, "%.31s", content);
+/* A trace-only span on the main track, for sub-steps that have no phase of their own */
+static void trace_span(const char *name, uint64_t t) {
+	if (timing.trace_path) trace_add(name, t, now_ns(), 0);
 }
 
-static void set_mountpoint_recursive(Node *node, const char *from, const char *target) {
-	if (strcmp(node->name, from) == 0) {
-		free(node->mountpoint);
-		node->mountpoint = strdup(target);
-		return;
+static void phase_end(int ph, uint64_t t) {
+	if (!timing.on) return;
+	if (mem.on) mem.cur = mem.prev[ph];
+	if (perf.on) {
+		uint64_t v[PC_MAX];
+		perf_read(v);
+		for (int i = 0; i < PC_MAX; i++)
+			perf.sum[ph][i] += v[i] - perf.start[ph][i];
 	}
-	for (int j = 0; j < node->nchildren; j++)
-		set_mountpoint_recursive(node->children[j], from, target);
+	uint64_t now = now_ns();
+	timing.ns[ph] += now - t;
+	timing.count[ph]++;
+	if (timing.trace_path) trace_add(phase_names[ph], t, now, 0);
 }
 
-/* Build mount map from getmntinfo */
-static void fill_mountpoints(Node **roots, int nroots) {
-	struct statfs *mntbuf = NULL;
-	int count = getmntinfo(&mntbuf, MNT_NOWAIT);
-	if (count <= 0 || !mntbuf) return;
+/* Span of one info child on its job slot's track */
+static void trace_child(uint64_t t, int slot, pid_t pid, const char *dev) {
+	if (!timing.trace_path) return;
+	TraceEvent *e = trace_add("diskutil info", t, now_ns(), slot + 1);
+	if (!e) return;
+	e->pid = (int)pid;
+	snprintf(e->dev, sizeof(e->dev), "%s", dev);
+}
 
-	for (int i = 0; i < count; i++) {
-		const char *from = mntbuf[i].f_mntfromname;
-		const char *target = mntbuf[i].f_mntonname;
-		if (!from || !target) continue;
-		/* from is like /dev/disk1s1 */
-		if (strncmp(from, "/dev/", 5) != 0) continue;
-		from += 5;
+static void timing_spawn(uint64_t t) {
+	if (!timing.report) return;
+	if (timing.nspawn == timing.cap) {
+		size_t cap = timing.cap ? timing.cap * 2 : 256;
+		uint32_t *p = mem_realloc(timing.spawn_us, cap * sizeof(uint32_t));
+		if (!p) return;
+		timing.spawn_us = p;
+		timing.cap = cap;
+	}
+	uint64_t us = (now_ns() - t) / 1000;
+	timing.spawn_us[timing.nspawn++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
 
-		for (int r = 0; r < nroots; r++)
-			set_mountpoint_recursive(roots[r], from, target);
+/* Summary on stderr: phase table, then spawn latency percentiles and a log2 histogram */
+static void timing_report(void) {
+	if (!timing.report) return;
+	double total = (double)(now_ns() - timing.t0) / 1e6;
+	uint32_t *lat = timing.spawn_us;
+	size_t n = timing.nspawn;
+	int hist[33] = { 0 };
+	if (n) qsort(lat, n, sizeof(uint32_t), cmp_u32);
+	for (size_t i = 0; i < n; i++)
+		hist[lat[i] ? 32 - __builtin_clz(lat[i]) : 0]++;   /* bucket b: [2^(b-1), 2^b) us */
+#define PCT(p) (n ? lat[(n * (p) + 99) / 100 - 1] / 1000.0 : 0.0)
+	FILE *f = stderr;
+	if (timing.json) {
+		fprintf(f, "{\"phases\":{");
+		for (int i = 0; i < PH_MAX; i++)
+			fprintf(f, "%s\"%s\":{\"ms\":%.3f,\"count\":%llu}", i ? "," : "", phase_names[i],
+				(double)timing.ns[i] / 1e6, (unsigned long long)timing.count[i]);
+		fprintf(f, "},\"total_ms\":%.3f,\"spawns\":{\"count\":%zu", total, n);
+		if (n)
+			fprintf(f, ",\"min_ms\":%.3f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f",
+				lat[0] / 1000.0, PCT(50), PCT(90), PCT(99), lat[n - 1] / 1000.0);
+		fprintf(f, ",\"histogram\":[");
+		for (int b = 0, first = 1; b < 33; b++) {
+			if (!hist[b]) continue;
+			fprintf(f, "%s{\"lo_ms\":%.3f,\"hi_ms\":%.3f,\"count\":%d}", first ? "" : ",",
+				b ? (double)(1u << (b - 1)) / 1000 : 0.0, (double)(1ull << b) / 1000, hist[b]);
+			first = 0;
+		}
+		fprintf(f, "]}}\n");
+	} else {
+		fprintf(f, "mlsblk: timing (ms)\n");
+		for (int i = 0; i < PH_MAX; i++)
+			fprintf(f, "  %s%-*s %10.3f  (%llu)\n", phase_nested[i] ? "  " : "", phase_nested[i] ? 10 : 12,
+				phase_names[i], (double)timing.ns[i] / 1e6, (unsigned long long)timing.count[i]);
+		fprintf(f, "  %-12s %10.3f\n", "total", total);
+		fprintf(f, "  info spawns: %zu", n);
+		if (n)
+			fprintf(f, ", ms min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f", lat[0] / 1000.0,
+				PCT(50), PCT(90), PCT(99), lat[n - 1] / 1000.0);
+		fprintf(f, "\n");
+		for (int b = 0; b < 33; b++)
+			if (hist[b])
+				fprintf(f, "    %9.3f - %9.3f ms %6d\n", b ? (double)(1u << (b - 1)) / 1000 : 0.0,
+					(double)(1ull << b) / 1000, hist[b]);
 	}
+#undef PCT
+	mem_free(timing.spawn_us);
 }
 
-/* Fill node from diskutil info -plist (for -f) */
-static void fill_info(Node *n) {
-	CFDictionaryRef info = get_info_plist(n->name);
-	if (!info) return;
-	CFTypeRef v;
-	v = CFDictionaryGetValue(info, CFSTR("FilesystemType"));
-	if (v) {
-		char *s = cfstr(v);
-		if (s) { free(n->fstype); n->fstype = s; }
+/* Write the spans as a Chrome / Perfetto JSON trace (complete "X" events, microseconds) */
+static void trace_write(void) {
+	if (!timing.trace_path) return;
+	FILE *f = fopen(timing.trace_path, "w");
+	if (!f) {
+		fprintf(stderr, "mlsblk: cannot write %s: %s\n", timing.trace_path, strerror(errno));
+		mem_free(timing.ev);
+		return;
 	}
-	v = CFDictionaryGetValue(info, CFSTR("VolumeName"));
-	if (v) {
-		char *s = cfstr(v);
-		if (s && s[0]) { free(n->label); n->label = s; } else free(s);
+	int pid = (int)getpid();
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(f, "{\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"mlsblk\"}}", pid);
+	for (int tid = 0; tid <= timing.ntracks; tid++) {
+		fprintf(f, ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":", pid, tid);
+		if (tid) fprintf(f, "\"info job %d\"}}", tid);
+		else fprintf(f, "\"main\"}}");
+	}
+	for (size_t i = 0; i < timing.nev; i++) {
+		const TraceEvent *e = &timing.ev[i];
+		fprintf(f, ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f",
+			pid, e->tid, e->name, e->ts / 1000.0, e->dur / 1000.0);
+		if (e->dev[0]) {
+			/* device names are diskN[sM...]; drop anything that would need escaping */
+			fprintf(f, ",\"args\":{\"device\":\"");
+			for (const char *c = e->dev; *c; c++)
+				if (*c >= ' ' && *c != '"' && *c != '\\') fputc(*c, f);
+			fprintf(f, "\"");
+			if (e->pid) fprintf(f, ",\"pid\":%d", e->pid);
+			fprintf(f, "}");
+		}
+		fprintf(f, "}");
 	}
-	if (!n->label || !n->label[0]) {
-		v = CFDictionaryGetValue(info, CFSTR("MediaName"));
-		if (v) { char *s = cfstr(v); if (s && s[0]) { free(n->label); n->label = s; } else free(s); }
+	fprintf(f, "\n]}\n");
+	if (fclose(f) != 0)
+		fprintf(stderr, "mlsblk: cannot write %s: %s\n", timing.trace_path, strerror(errno));
+	mem_free(timing.ev);
+}
+
+/* diskutil binary; MLSBLK_DISKUTIL overrides it (e.g. a stand-in script for benchmarks) */
+static const char *diskutil_path(void) {
+	const char *p = getenv("MLSBLK_DISKUTIL");
+	return p && p[0] ? p : "diskutil";
+}
+
+/* Spawn diskutil with args, stdout on a pipe, stderr to /dev/null. Returns read end or -1. */
+static int spawn_diskutil(const char *const args[], pid_t *pid) {
+	char *argv[8] = { (char *)diskutil_path() };
+	for (int i = 0; args[i] && i < 6; i++)
+		argv[i + 1] = (char *)args[i];
+
+	int pfd[2];
+	if (pipe(pfd) != 0) return -1;
+	/* Keep both ends out of sibling children, or their EOF never arrives */
+	fcntl(pfd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pfd[1], F_SETFD, FD_CLOEXEC);
+
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_adddup2(&fa, pfd[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addopen(&fa, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+	int rc = posix_spawnp(pid, argv[0], &fa, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	close(pfd[1]);
+	if (rc != 0) { close(pfd[0]); return -1; }
+	return pfd[0];
+}
+
+/* Read fd to EOF into a malloc'd, NUL-terminated buffer */
+static char *read_all(int fd, size_t *lenp) {
+	size_t cap = 65536, len = 0;
+	char *buf = mem_malloc(cap);
+	if (!buf) return NULL;
+	for (;;) {
+		if (cap - len < 1024) {
+			cap *= 2;
+			char *n = mem_realloc(buf, cap);
+			if (!n) { mem_free(buf); return NULL; }
+			buf = n;
+		}
+		ssize_t r = read(fd, buf + len, cap - len - 1);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) break;
+		len += (size_t)r;
 	}
-	v = CFDictionaryGetValue(info, CFSTR("VolumeUUID"));
-	if (!v) v = CFDictionaryGetValue(info, CFSTR("DiskUUID"));
-	if (v) {
-		char *s = cfstr(v);
-		if (s) { free(n->uuid); n->uuid = s; }
+	buf[len] = '\0';
+	*lenp = len;
+	return buf;
+}
+
+/*
+ * Minimal XML plist reader. The document is tokenized in place: keys and
+ * strings are views into the caller's buffer, and only text that contains
+ * '&' is entity-decoded (into pl->scratch). Values live in one node array
+ * linked by index; dict children alternate key, value.
+ */
+enum PlType { PL_DICT, PL_ARRAY, PL_KEY, PL_STRING, PL_INTEGER, PL_REAL, PL_TRUE, PL_FALSE, PL_DATA, PL_DATE };
+
+typedef struct {
+	uint8_t type;
+	int next;             /* next sibling, -1 at end */
+	int child;            /* first child of dict/array, -1 if empty */
+	const char *s;        /* text (not NUL-terminated) */
+	size_t len;
+} PlNode;
+
+typedef struct {
+	PlNode *nodes;
+	int n, cap;
+	int root;
+	char *scratch;        /* decoded text; never longer than the input */
+	size_t scratch_used;
+	const char *p, *end;  /* cursor while parsing */
+	size_t srclen;
+} Plist;
+
+typedef struct {
+	const char *name;
+	size_t nlen;
+	bool close, empty;
+} PlTag;
+
+#define PL_MAX_DEPTH 64
+
+/* First '<' or '&' in [p, end), or end */
+static const char *scan_markup(const char *p, const char *end) {
+#if defined(__SSE2__)
+	const __m128i lt = _mm_set1_epi8('<'), amp = _mm_set1_epi8('&');
+	for (; end - p >= 16; p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned m = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)));
+		if (m) return p + __builtin_ctz(m);
 	}
-	v = CFDictionaryGetValue(info, CFSTR("MountPoint"));
-	if (v) {
-		char *s = cfstr(v);
-		if (s && s[0]) { free(n->mountpoint); n->mountpoint = s; } else free(s);
+#elif defined(__ARM_NEON)
+	const uint8x16_t lt = vdupq_n_u8('<'), amp = vdupq_n_u8('&');
+	for (; end - p >= 16; p += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)p);
+		uint8x16_t m = vorrq_u8(vceqq_u8(v, lt), vceqq_u8(v, amp));
+		/* narrow to 4 bits per byte so the match mask fits in 64 bits */
+		uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (bits) return p + (__builtin_ctzll(bits) >> 2);
 	}
-	CFRelease(info);
+#endif
+	for (; p < end; p++)
+		if (*p == '<' || *p == '&') return p;
+	return end;
 }
 
-/* Recursively collect all nodes from AllDisksAndPartitions into a flat list and tree */
-typedef struct { Node **arr; int n, cap; } NodeArray;
-static void collect_nodes(CFArrayRef all, Node **roots, int *nroots, NodeArray *flat, Node *parent);
+static int pl_new(Plist *pl, int type) {
+	if (pl->n >= pl->cap) {
+		int ncap = pl->cap ? pl->cap * 2 : 256;
+		PlNode *nn = mem_realloc(pl->nodes, (size_t)ncap * sizeof(PlNode));
+		if (!nn) return -1;
+		pl->nodes = nn;
+		pl->cap = ncap;
+	}
+	pl->nodes[pl->n] = (PlNode){ (uint8_t)type, -1, -1, "", 0 };
+	return pl->n++;
+}
 
-static Node *ensure_node(NodeArray *flat, const char *name, uint64_t size, const char *type) {
-	for (int i = 0; i < flat->n; i++)
-		if (strcmp(flat->arr[i]->name, name) == 0)
-			return flat->arr[i];
-	Node *n = node_create(name, size, type);
-	if (!n) return NULL;
-	if (flat->n >= flat->cap) {
-		int newcap = flat->cap ? flat->cap * 2 : 64;
-		Node **p = realloc(flat->arr, (size_t)newcap * sizeof(Node *));
-		if (!p) { node_free(n); return NULL; }
-		flat->arr = p;
-		flat->cap = newcap;
+static size_t utf8_put(char *out, unsigned long cp) {
+	if (cp < 0x80) { out[0] = (char)cp; return 1; }
+	if (cp < 0x800) { out[0] = (char)(0xC0 | (cp >> 6)); out[1] = (char)(0x80 | (cp & 0x3F)); return 2; }
+	if (cp < 0x10000) {
+		out[0] = (char)(0xE0 | (cp >> 12));
+		out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		out[2] = (char)(0x80 | (cp & 0x3F));
+		return 3;
 	}
-	flat->arr[flat->n++] = n;
-	return n;
+	out[0] = (char)(0xF0 | (cp >> 18));
+	out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+	out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+	out[3] = (char)(0x80 | (cp & 0x3F));
+	return 4;
 }
 
-static void add_partition(NodeArray *flat, Node **roots, int *nroots, Node *disk_node, CFDictionaryRef part) {
-	(void)roots;
-	(void)nroots;
-	CFTypeRef idref = CFDictionaryGetValue(part, CFSTR("DeviceIdentifier"));
-	CFTypeRef sizeref = CFDictionaryGetValue(part, CFSTR("Size"));
-	CFTypeRef content = CFDictionaryGetValue(part, CFSTR("Content"));
-	char *idstr = cfstr(idref);
-	if (!idstr) return;
-	uint64_t sz = cfint(sizeref);
-	char *contentstr = content ? cfstr(content) : NULL;
-	Node *child = ensure_node(flat, idstr, sz, "part");
-	free(idstr);
-	if (child) {
-		char fstype[64];
-		content_to_fstype(contentstr, fstype, sizeof(fstype));
-		free(child->fstype);
-		child->fstype = strdup(fstype);
-		if (disk_node)
-			node_add_child(disk_node, child);
-	}
-	free(contentstr);
-}
-
-static void add_apfs_volume(NodeArray *flat, Node *container_node, CFDictionaryRef vol) {
-	CFTypeRef idref = CFDictionaryGetValue(vol, CFSTR("DeviceIdentifier"));
-	CFTypeRef sizeref = CFDictionaryGetValue(vol, CFSTR("Size"));
-	CFTypeRef mount = CFDictionaryGetValue(vol, CFSTR("MountPoint"));
-	CFTypeRef volname = CFDictionaryGetValue(vol, CFSTR("VolumeName"));
-	CFTypeRef voluuid = CFDictionaryGetValue(vol, CFSTR("VolumeUUID"));
-	char *idstr = cfstr(idref);
-	if (!idstr) return;
-	uint64_t sz = cfint(sizeref);
-	Node *child = ensure_node(flat, idstr, sz, "part");
-	free(idstr);
-	if (!child) return;
-	if (container_node)
-		node_add_child(container_node, child);
-	char *mp = mount ? cfstr(mount) : NULL;
-	if (mp && mp[0]) { free(child->mountpoint); child->mountpoint = mp; } else free(mp);
-	char *lab = volname ? cfstr(volname) : NULL;
-	if (lab && lab[0]) { free(child->label); child->label = lab; } else free(lab);
-	char *uuid = voluuid ? cfstr(voluuid) : NULL;
-	if (uuid) { free(child->uuid); child->uuid = uuid; }
-	child->fstype = realloc(child->fstype, 5);
-	if (child->fstype) strcpy(child->fstype, "apfs");
-}
-
-static void collect_nodes(CFArrayRef all, Node **roots, int *nroots, NodeArray *flat, Node *parent) {
-	CFIndex cnt = CFArrayGetCount(all);
-	for (CFIndex i = 0; i < cnt; i++) {
-		CFDictionaryRef d = (CFDictionaryRef)CFArrayGetValueAtIndex(all, i);
-		if (CFGetTypeID(d) != CFDictionaryGetTypeID()) continue;
-
-		CFTypeRef idref = CFDictionaryGetValue(d, CFSTR("DeviceIdentifier"));
-		CFTypeRef sizeref = CFDictionaryGetValue(d, CFSTR("Size"));
-		CFTypeRef content = CFDictionaryGetValue(d, CFSTR("Content"));
-		char *idstr = cfstr(idref);
-		if (!idstr) continue;
-		uint64_t sz = cfint(sizeref);
-		char *contentstr = content ? cfstr(content) : NULL;
-		/* Whole disk or APFS container */
-		bool is_container = contentstr && strstr(contentstr, "Apple_APFS_Container");
-		bool is_whole = contentstr && (strstr(contentstr, "GUID_partition_scheme") || is_container);
-
-		Node *disk_node = ensure_node(flat, idstr, sz, is_whole ? "disk" : "part");
-		free(idstr);
-		if (!disk_node) { free(contentstr); continue; }
-		if (contentstr) {
-			char buf[64];
-			content_to_fstype(contentstr, buf, sizeof(buf));
-			free(disk_node->fstype);
-			disk_node->fstype = strdup(buf);
-		}
-
-		if (!parent) {
-			if (*nroots >= 64) { free(contentstr); continue; }
-			roots[(*nroots)++] = disk_node;
+/* Decode XML entities of [s, s+len) into out; returns the length or (size_t)-1. Never grows the text. */
+static size_t xml_unescape(char *out, const char *s, size_t len) {
+	char *o = out;
+	const char *end = s + len;
+	while (s < end) {
+		const char *amp = memchr(s, '&', (size_t)(end - s));
+		if (!amp) amp = end;
+		memcpy(o, s, (size_t)(amp - s));
+		o += amp - s;
+		if (amp == end) break;
+		const char *semi = memchr(amp, ';', (size_t)(end - amp));
+		if (!semi) return (size_t)-1;
+		const char *e = amp + 1;
+		size_t elen = (size_t)(semi - e);
+		if (elen == 2 && !memcmp(e, "lt", 2)) *o++ = '<';
+		else if (elen == 2 && !memcmp(e, "gt", 2)) *o++ = '>';
+		else if (elen == 3 && !memcmp(e, "amp", 3)) *o++ = '&';
+		else if (elen == 4 && !memcmp(e, "quot", 4)) *o++ = '"';
+		else if (elen == 4 && !memcmp(e, "apos", 4)) *o++ = '\'';
+		else if (elen >= 2 && e[0] == '#') {
+			char *numend;
+			unsigned long cp = (e[1] == 'x') ? strtoul(e + 2, &numend, 16) : strtoul(e + 1, &numend, 10);
+			if (numend != semi || cp == 0 || cp > 0x10FFFF) return (size_t)-1;
+			o += utf8_put(o, cp);
 		} else
-			node_add_child(parent, disk_node);
+			return (size_t)-1;
+		s = semi + 1;
+	}
+	return (size_t)(o - out);
+}
 
-		/* Partitions (physical) */
-		CFArrayRef parts = (CFArrayRef)CFDictionaryGetValue(d, CFSTR("Partitions"));
-		if (parts && CFGetTypeID(parts) == CFArrayGetTypeID()) {
-			CFIndex np = CFArrayGetCount(parts);
-			for (CFIndex j = 0; j < np; j++)
-				add_partition(flat, roots, nroots, disk_node, (CFDictionaryRef)CFArrayGetValueAtIndex(parts, j));
-		}
+/* Entity-decode a text node into scratch */
+static bool pl_decode(Plist *pl, PlNode *nd, const char *s, size_t len) {
+	if (!pl->scratch && !(pl->scratch = mem_malloc(pl->srclen))) return false;
+	char *out = pl->scratch + pl->scratch_used;
+	size_t n = xml_unescape(out, s, len);
+	if (n == (size_t)-1) return false;
+	nd->s = out;
+	nd->len = n;
+	pl->scratch_used += n;
+	return true;
+}
 
-		/* APFS volumes */
-		CFArrayRef apfs_vols = (CFArrayRef)CFDictionaryGetValue(d, CFSTR("APFSVolumes"));
-		if (apfs_vols && CFGetTypeID(apfs_vols) == CFArrayGetTypeID()) {
-			CFIndex nv = CFArrayGetCount(apfs_vols);
-			for (CFIndex j = 0; j < nv; j++)
-				add_apfs_volume(flat, disk_node, (CFDictionaryRef)CFArrayGetValueAtIndex(apfs_vols, j));
+/* Advance to the next element tag, skipping text, <?...?>, <!--...--> and <!DOCTYPE ...> */
+static bool pl_tag(Plist *pl, PlTag *t) {
+	for (;;) {
+		const char *p = memchr(pl->p, '<', (size_t)(pl->end - pl->p));
+		if (!p || p + 1 >= pl->end) return false;
+		if (p[1] == '?' || p[1] == '!') {
+			const char *close = (p + 3 < pl->end && p[2] == '-' && p[3] == '-') ? "-->" : (p[1] == '?' ? "?>" : ">");
+			const char *q = memmem(p + 2, (size_t)(pl->end - p - 2), close, strlen(close));
+			if (!q) return false;
+			pl->p = q + strlen(close);
+			continue;
 		}
-
-		free(contentstr);
+		const char *gt = memchr(p, '>', (size_t)(pl->end - p));
+		if (!gt) return false;
+		t->close = (p[1] == '/');
+		t->name = p + 1 + t->close;
+		const char *q = t->name;
+		while (q < gt && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n' && *q != '/')
+			q++;
+		t->nlen = (size_t)(q - t->name);
+		t->empty = (gt[-1] == '/');
+		pl->p = gt + 1;
+		return true;
 	}
 }
 
-/* Parse AllDisksAndPartitions and build tree. Roots are top-level disks. */
-static int build_tree(CFDictionaryRef list_plist, Node **roots, int *nroots, NodeArray *flat) {
-	CFArrayRef all = (CFArrayRef)CFDictionaryGetValue(list_plist, CFSTR("AllDisksAndPartitions"));
-	if (!all || CFGetTypeID(all) != CFArrayGetTypeID()) return -1;
-	flat->arr = NULL;
-	flat->n = flat->cap = 0;
-	*nroots = 0;
-	collect_nodes(all, roots, nroots, flat, NULL);
-	/* Sort roots and each level of children */
-	for (int i = 0; i < *nroots; i++)
-		sort_children(roots[i]);
-	qsort(roots, (size_t)*nroots, sizeof(Node *), node_cmp);
-	return 0;
+static bool tag_is(const PlTag *t, const char *name) {
+	return t->nlen == strlen(name) && memcmp(t->name, name, t->nlen) == 0;
 }
 
-/* Column names we support */
-enum Col { COL_NAME, COL_SIZE, COL_TYPE, COL_MOUNTPOINT, COL_FSTYPE, COL_LABEL, COL_UUID, COL_MAX };
-static const char *col_names[] = { "NAME", "SIZE", "TYPE", "MOUNTPOINT", "FSTYPE", "LABEL", "UUID" };
+/* Text content of a scalar element, up to and including its close tag */
+static int pl_text(Plist *pl, int type, const PlTag *open) {
+	int i = pl_new(pl, type);
+	if (i < 0 || open->empty) return i;
+	const char *start = pl->p;
+	const char *q = scan_markup(start, pl->end);
+	bool escaped = (q < pl->end && *q == '&');
+	if (escaped)
+		q = memchr(q, '<', (size_t)(pl->end - q));
+	if (!q || q >= pl->end) return -1;
+	pl->nodes[i].s = start;
+	pl->nodes[i].len = (size_t)(q - start);
+	if (escaped && !pl_decode(pl, &pl->nodes[i], start, (size_t)(q - start))) return -1;
+	pl->p = q;
+	PlTag close;
+	if (!pl_tag(pl, &close) || !close.close || close.nlen != open->nlen || memcmp(close.name, open->name, open->nlen))
+		return -1;
+	return i;
+}
 
-static int parse_columns(const char *ostr, int *cols, int *ncols) {
-	*ncols = 0;
-	char *s = strdup(ostr);
-	if (!s) return -1;
-	for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
-		while (*tok == ' ') tok++;
-		for (int c = 0; c < COL_MAX; c++)
-			if (strcasecmp(tok, col_names[c]) == 0) {
-				if (*ncols >= 32) { free(s); return -1; }
-				cols[(*ncols)++] = c;
-				break;
-			}
+static int pl_value(Plist *pl, const PlTag *t, int depth);
+
+/* Children of a dict or array up to its close tag */
+static int pl_container(Plist *pl, int type, const PlTag *open, int depth) {
+	int i = pl_new(pl, type);
+	if (i < 0 || open->empty) return i;
+	int last = -1;
+	PlTag t;
+	for (;;) {
+		if (!pl_tag(pl, &t)) return -1;
+		if (t.close) return tag_is(&t, type == PL_DICT ? "dict" : "array") ? i : -1;
+		int c;
+		if (type == PL_DICT) {
+			if (!tag_is(&t, "key") || (c = pl_text(pl, PL_KEY, &t)) < 0) return -1;
+			PlTag vt;
+			int v;
+			if (!pl_tag(pl, &vt) || vt.close || (v = pl_value(pl, &vt, depth + 1)) < 0) return -1;
+			pl->nodes[c].next = v;
+			if (last < 0) pl->nodes[i].child = c;
+			else pl->nodes[last].next = c;
+			last = v;
+		} else {
+			if ((c = pl_value(pl, &t, depth + 1)) < 0) return -1;
+			if (last < 0) pl->nodes[i].child = c;
+			else pl->nodes[last].next = c;
+			last = c;
+		}
 	}
-	free(s);
-	return 0;
 }
 
-static int parse_output_option(const char *ostr, int *cols, int *ncols) {
-	if (!ostr || !ostr[0]) {
-		const char *def = DEFAULT_COLS;
-		return parse_columns(def, cols, ncols);
-	}
-	return parse_columns(ostr, cols, ncols);
-}
-
-static void print_tree(Node *n, int *cols, int ncols, const char *prefix, bool last) {
-	char sizebuf[32];
-	char child_prefix[256];
-	snprintf(child_prefix, sizeof(child_prefix), "%s%s  ", prefix, last ? " " : "│");
-
-	for (int i = 0; i < n->nchildren; i++) {
-		Node *ch = n->children[i];
-		bool is_last = (i == n->nchildren - 1);
-		fmt_size(ch->size, sizebuf, sizeof(sizebuf));
-		printf("%s%s── %s", prefix, is_last ? "└" : "├", ch->name);
-		for (int c = 1; c < ncols; c++) {
-			switch (cols[c]) {
-			case COL_NAME: break;
-			case COL_SIZE: printf(" %s", sizebuf); break;
-			case COL_TYPE: printf(" %s", ch->type); break;
-			case COL_MOUNTPOINT: printf(" %s", ch->mountpoint[0] ? ch->mountpoint : ""); break;
-			case COL_FSTYPE: printf(" %s", ch->fstype[0] ? ch->fstype : ""); break;
-			case COL_LABEL: printf(" %s", ch->label[0] ? ch->label : ""); break;
-			case COL_UUID: printf(" %s", ch->uuid[0] ? ch->uuid : ""); break;
-			default: break;
-			}
-		}
-		printf("\n");
-		print_tree(ch, cols, ncols, child_prefix, is_last);
+static int pl_value(Plist *pl, const PlTag *t, int depth) {
+	if (depth > PL_MAX_DEPTH) return -1;
+	if (tag_is(t, "dict")) return pl_container(pl, PL_DICT, t, depth);
+	if (tag_is(t, "array")) return pl_container(pl, PL_ARRAY, t, depth);
+	if (tag_is(t, "string")) return pl_text(pl, PL_STRING, t);
+	if (tag_is(t, "integer")) return pl_text(pl, PL_INTEGER, t);
+	if (tag_is(t, "real")) return pl_text(pl, PL_REAL, t);
+	if (tag_is(t, "data")) return pl_text(pl, PL_DATA, t);
+	if (tag_is(t, "date")) return pl_text(pl, PL_DATE, t);
+	if (tag_is(t, "true") || tag_is(t, "false")) {
+		int i = pl_new(pl, t->name[0] == 't' ? PL_TRUE : PL_FALSE);
+		PlTag close;
+		if (i >= 0 && !t->empty && (!pl_tag(pl, &close) || !close.close)) return -1;
+		return i;
 	}
+	return -1;
 }
 
-static void print_list_dfs(Node *n, int *cols, int ncols, char *sizebuf) {
-	fmt_size(n->size, sizebuf, sizeof(sizebuf));
-	for (int c = 0; c < ncols; c++) {
-		if (c) printf(" ");
-		switch (cols[c]) {
-		case COL_NAME: printf("%s", n->name); break;
-		case COL_SIZE: printf("%s", sizebuf); break;
-		case COL_TYPE: printf("%s", n->type); break;
-		case COL_MOUNTPOINT: printf("%s", n->mountpoint[0] ? n->mountpoint : ""); break;
-		case COL_FSTYPE: printf("%s", n->fstype[0] ? n->fstype : ""); break;
-		case COL_LABEL: printf("%s", n->label[0] ? n->label : ""); break;
-		case COL_UUID: printf("%s", n->uuid[0] ? n->uuid : ""); break;
-		default: break;
+static void plist_free(Plist *pl) {
+	mem_free(pl->nodes);
+	mem_free(pl->scratch);
+	*pl = (Plist){ 0 };
+}
+
+/* Parse an XML plist; views in pl stay valid as long as buf does */
+static int plist_parse(Plist *pl, const char *buf, size_t len) {
+	*pl = (Plist){ .p = buf, .end = buf + len, .srclen = len, .root = -1 };
+	if (!buf) return -1;
+	PlTag t;
+	while (pl_tag(pl, &t))
+		if (!t.close && tag_is(&t, "plist")) {
+			if (!pl_tag(pl, &t) || t.close || (pl->root = pl_value(pl, &t, 0)) < 0) break;
+			return 0;
 		}
-	}
-	printf("\n");
-	for (int j = 0; j < n->nchildren; j++)
-		print_list_dfs(n->children[j], cols, ncols, sizebuf);
+	plist_free(pl);
+	return -1;
 }
 
-static void print_list(Node **roots, int nroots, int *cols, int ncols) {
-	for (int c = 0; c < ncols; c++)
-		printf("%s%s", c ? " " : "", col_names[cols[c]]);
-	printf("\n");
-	char sizebuf[32];
-	for (int i = 0; i < nroots; i++)
-		print_list_dfs(roots[i], cols, ncols, sizebuf);
+/* Value for key in dict, or -1 */
+static int pl_get(const Plist *pl, int dict, const char *key) {
+	if (dict < 0 || pl->nodes[dict].type != PL_DICT) return -1;
+	size_t klen = strlen(key);
+	for (int k = pl->nodes[dict].child; k >= 0; k = pl->nodes[pl->nodes[k].next].next)
+		if (pl->nodes[k].len == klen && memcmp(pl->nodes[k].s, key, klen) == 0)
+			return pl->nodes[k].next;
+	return -1;
 }
 
-static void emit_json(Node *n, int depth, bool first) {
-	if (!first) printf(",\n");
-	printf("%*s{\"name\":\"%s\",\"size\":%llu,\"type\":\"%s\",\"mountpoint\":\"%s\",\"fstype\":\"%s\",\"label\":\"%s\",\"uuid\":\"%s\"",
-		depth * 2, "", n->name, (unsigned long long)n->size, n->type,
-		n->mountpoint[0] ? n->mountpoint : "", n->fstype[0] ? n->fstype : "",
-		n->label[0] ? n->label : "", n->uuid[0] ? n->uuid : "");
-	if (n->nchildren > 0) {
-		printf(",\"children\":[");
-		for (int i = 0; i < n->nchildren; i++)
-			emit_json(n->children[i], depth + 1, i == 0);
-		printf("\n%*s]", depth * 2, "");
-	}
-	printf("}");
+static bool pl_is(const Plist *pl, int i, int type) {
+	return i >= 0 && pl->nodes[i].type == type;
 }
 
-static void print_json(Node **roots, int nroots) {
-	printf("{\"blockdevices\":[\n");
-	for (int i = 0; i < nroots; i++) {
-		if (i) printf(",\n");
-		emit_json(roots[i], 1, true);
-	}
-	printf("\n]}\n");
+/* Arena copy of a string value, NULL if i is not a string */
+static const char *plstr(Arena *a, const Plist *pl, int i) {
+	if (!pl_is(pl, i, PL_STRING)) return NULL;
+	return arena_strndup(a, pl->nodes[i].s, pl->nodes[i].len);
 }
 
-int main(int argc, char **argv) {
-	bool opt_f = false;
-	bool opt_J = false;
-	bool opt_list = false;
-	char *opt_o = NULL;
+static uint64_t parse_int(const char *s, size_t len) {
+	const char *end = s + len;
+	while (s < end && (*s == ' ' || *s == '\t' || *s == '\n')) s++;
+	bool neg = (s < end && *s == '-');
+	if (neg || (s < end && *s == '+')) s++;
+	uint64_t v = 0;
+	for (; s < end && *s >= '0' && *s <= '9'; s++)
+		v = v * 10 + (uint64_t)(*s - '0');
+	return neg ? (uint64_t)0 - v : v;
+}
 
-	int ch;
-	while ((ch = getopt(argc, argv, "fo:Jl")) != -1) {
-		switch (ch) {
-		case 'f': opt_f = true; break;
-		case 'o': opt_o = optarg; break;
-		case 'J': opt_J = true; break;
-		case 'l': opt_list = true; break;
-		default:
-			fprintf(stderr, "Usage: mlsblk [-f] [-o COL1,COL2] [-J] [-l]\n");
-			fprintf(stderr, "  -f  include FSTYPE,LABEL,UUID\n");
-			fprintf(stderr, "  -o  output columns (e.g. NAME,SIZE,FSTYPE,MOUNTPOINT)\n");
-			fprintf(stderr, "  -J  JSON output\n");
-			fprintf(stderr, "  -l  list format instead of tree\n");
-			return 1;
+/*
+ * Push (SAX) plist reader: fed arbitrary chunks, it reports dict/array
+ * begin/end and scalar values. Only a token cut by a chunk boundary is
+ * copied (into carry); everything else is reported straight from the chunk.
+ * A handler skips a subtree by setting skip_next (the value after a key)
+ * or skip (the container just begun); skipped text is never decoded.
+ */
+typedef struct PlSax PlSax;
+struct PlSax {
+	void (*begin)(PlSax *x, int type);
+	void (*end)(PlSax *x, int type);
+	void (*scalar)(PlSax *x, int type, const char *s, size_t len);
+	int skip;             /* >0: nesting depth inside a skipped container */
+	bool skip_next;       /* skip the next value */
+	bool error;
+	/* tokenizer state */
+	bool in_tag;          /* carry holds a partial tag rather than text */
+	int elem;             /* type of the open scalar element, -1 if none */
+	bool got_text, drop;  /* scalar text reported / scalar being skipped */
+	char *carry;
+	size_t clen, ccap;
+	char *scratch;
+	size_t scap;
+};
+
+static void sax_init(PlSax *x) {
+	*x = (PlSax){ .elem = -1 };
+}
+
+static void sax_free(PlSax *x) {
+	mem_free(x->carry);
+	mem_free(x->scratch);
+	x->carry = x->scratch = NULL;
+}
+
+static int sax_type(const char *name, size_t nlen) {
+	static const struct { const char *name; int type; } types[] = {
+		{ "dict", PL_DICT }, { "array", PL_ARRAY }, { "key", PL_KEY }, { "string", PL_STRING },
+		{ "integer", PL_INTEGER }, { "real", PL_REAL }, { "true", PL_TRUE }, { "false", PL_FALSE },
+		{ "data", PL_DATA }, { "date", PL_DATE },
+	};
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		if (strlen(types[i].name) == nlen && memcmp(types[i].name, name, nlen) == 0)
+			return types[i].type;
+	return -1;
+}
+
+/* Text between tags; only meaningful inside a scalar element */
+static void sax_text(PlSax *x, const char *s, size_t len, bool escaped) {
+	if (x->elem < 0 || x->drop || x->skip) return;
+	if (escaped) {
+		if (x->scap < len) {
+			char *n = mem_realloc(x->scratch, len);
+			if (!n) { x->error = true; return; }
+			x->scratch = n;
+			x->scap = len;
 		}
+		size_t n = xml_unescape(x->scratch, s, len);
+		if (n == (size_t)-1) { x->error = true; return; }
+		s = x->scratch;
+		len = n;
 	}
+	x->scalar(x, x->elem, s, len);
+	x->got_text = true;
+}
 
-	int cols[32], ncols = 0;
-	if (parse_output_option(opt_o, cols, &ncols) != 0) {
-		fprintf(stderr, "mlsblk: invalid -o columns\n");
-		return 1;
+/* One complete tag "<...>" */
+static void sax_tag(PlSax *x, const char *t, size_t len) {
+	if (t[1] == '?' || t[1] == '!') return;
+	bool close = (t[1] == '/');
+	const char *name = t + 1 + close;
+	size_t nlen = 0;
+	while (name + nlen < t + len - 1 && !strchr(" \t\r\n/", name[nlen]))
+		nlen++;
+	bool empty = !close && t[len - 2] == '/';
+	if (nlen == 5 && memcmp(name, "plist", 5) == 0) return;
+	int type = sax_type(name, nlen);
+	if (type < 0) { x->error = true; return; }
+	bool container = (type == PL_DICT || type == PL_ARRAY);
+
+	if (close) {
+		if (container) {
+			if (x->skip) x->skip--;
+			else x->end(x, type);
+			return;
+		}
+		/* "<string></string>": no text token was reported */
+		if (!x->skip && !x->drop && !x->got_text) x->scalar(x, type, "", 0);
+		x->elem = -1;
+		x->drop = false;
+		return;
 	}
-	if (opt_f && !opt_o) {
-		parse_columns("NAME,SIZE,TYPE,FSTYPE,MOUNTPOINT,LABEL,UUID", cols, &ncols);
+	if (x->skip) {
+		if (container && !empty) x->skip++;
+		return;
 	}
-
-	CFDictionaryRef list_plist = get_list_plist();
-	if (!list_plist) {
-		fprintf(stderr, "mlsblk: failed to run diskutil list -plist\n");
-		return 1;
+	bool drop = x->skip_next;
+	x->skip_next = false;
+	if (container) {
+		if (drop) { if (!empty) x->skip = 1; return; }
+		x->begin(x, type);
+		if (empty && !x->skip) x->end(x, type);
+		else if (empty) x->skip = 0;
+		return;
 	}
+	if (empty) {
+		if (!drop) x->scalar(x, type, "", 0);
+		return;
+	}
+	x->elem = type;
+	x->got_text = false;
+	x->drop = drop;
+}
 
-	Node *roots[64];
-	int nroots = 0;
-	NodeArray flat = { 0 };
-	if (build_tree(list_plist, roots, &nroots, &flat) != 0) {
-		fprintf(stderr, "mlsblk: failed to parse disk list\n");
-		CFRelease(list_plist);
-		return 1;
+static bool sax_tag_complete(const char *t, size_t len) {
+	if (len >= 4 && memcmp(t, "<!--", 4) == 0)
+		return len >= 7 && memcmp(t + len - 3, "-->", 3) == 0;
+	return true;
+}
+
+static bool sax_carry(PlSax *x, const char *p, size_t len) {
+	if (x->clen + len > x->ccap) {
+		size_t ncap = x->ccap ? x->ccap : 256;
+		while (ncap < x->clen + len) ncap *= 2;
+		char *n = mem_realloc(x->carry, ncap);
+		if (!n) { x->error = true; return false; }
+		x->carry = n;
+		x->ccap = ncap;
 	}
-	CFRelease(list_plist);  /* done with plist */
+	memcpy(x->carry + x->clen, p, len);
+	x->clen += len;
+	return true;
+}
 
-	fill_mountpoints(roots, nroots);
+/* Feed the next chunk of the document */
+static void sax_feed(PlSax *x, const char *p, size_t len) {
+	const char *end = p + len;
 
-	if (opt_f) {
-		for (int i = 0; i < flat.n; i++)
-			fill_info(flat.arr[i]);
+	/* Finish a token cut by the previous chunk boundary */
+	while (x->clen && p < end && !x->error) {
+		if (!x->in_tag) {
+			const char *lt = memchr(p, '<', (size_t)(end - p));
+			if (!lt) { sax_carry(x, p, (size_t)(end - p)); return; }
+			if (!sax_carry(x, p, (size_t)(lt - p))) return;
+			sax_text(x, x->carry, x->clen, memchr(x->carry, '&', x->clen) != NULL);
+			x->clen = 0;
+			p = lt;
+			x->in_tag = true;
+			break;
+		}
+		const char *gt = memchr(p, '>', (size_t)(end - p));
+		if (!gt) { sax_carry(x, p, (size_t)(end - p)); return; }
+		if (!sax_carry(x, p, (size_t)(gt + 1 - p))) return;
+		p = gt + 1;
+		if (sax_tag_complete(x->carry, x->clen)) {
+			sax_tag(x, x->carry, x->clen);
+			x->clen = 0;
+			x->in_tag = false;
+		}
 	}
 
-	if (opt_J) {
-		print_json(roots, nroots);
-	} else if (opt_list) {
-		print_list(roots, nroots, cols, ncols);
-	} else {
-		/* Tree: print header then each root */
-		for (int c = 0; c < ncols; c++)
-			printf("%s%s", c ? " " : "", col_names[cols[c]]);
-		printf("\n");
-		char sizebuf[32];
-		for (int i = 0; i < nroots; i++) {
-			fmt_size(roots[i]->size, sizebuf, sizeof(sizebuf));
-			printf("%s", roots[i]->name);
-			for (int c = 1; c < ncols; c++) {
-				switch (cols[c]) {
-				case COL_NAME: break;
-				case COL_SIZE: printf(" %s", sizebuf); break;
-				case COL_TYPE: printf(" %s", roots[i]->type); break;
-				case COL_MOUNTPOINT: printf(" %s", roots[i]->mountpoint[0] ? roots[i]->mountpoint : ""); break;
-				case COL_FSTYPE: printf(" %s", roots[i]->fstype[0] ? roots[i]->fstype : ""); break;
-				case COL_LABEL: printf(" %s", roots[i]->label[0] ? roots[i]->label : ""); break;
-				case COL_UUID: printf(" %s", roots[i]->uuid[0] ? roots[i]->uuid : ""); break;
-				default: break;
-				}
+	while (p < end && !x->error) {
+		if (!x->in_tag) {
+			bool want = (x->elem >= 0 && !x->drop && !x->skip);
+			const char *lt = want ? scan_markup(p, end) : memchr(p, '<', (size_t)(end - p));
+			bool escaped = false;
+			if (lt && lt < end && *lt == '&') {
+				escaped = true;
+				lt = memchr(lt, '<', (size_t)(end - lt));
+			}
+			if (!lt || lt >= end) {
+				if (want) sax_carry(x, p, (size_t)(end - p));
+				return;
 			}
-			printf("\n");
-			print_tree(roots[i], cols, ncols, "  ", i == nroots - 1 && roots[i]->nchildren == 0);
+			if (want) sax_text(x, p, (size_t)(lt - p), escaped);
+			p = lt;
+			x->in_tag = true;
 		}
+		const char *gt = memchr(p, '>', (size_t)(end - p));
+		while (gt && !sax_tag_complete(p, (size_t)(gt + 1 - p)))
+			gt = memchr(gt + 1, '>', (size_t)(end - gt - 1));
+		if (!gt) { sax_carry(x, p, (size_t)(end - p)); return; }
+		sax_tag(x, p, (size_t)(gt + 1 - p));
+		p = gt + 1;
+		x->in_tag = false;
 	}
+}
+
+static bool has(const char *s, size_t len, const char *needle) {
+	return memmem(s, len, needle, strlen(needle)) != NULL;
+}
+
+/*
+ * Content string -> fstype for display. True if the type is certain: the
+ * EFI system partition is FAT by definition, shown as vfat like lsblk does;
+ * other contents are passed through as a guess.
+ */
+static bool content_to_fstype(const char *content, size_t len, char *out, size_t outsz) {
+	if (!content) { out[0] = '\0'; return false; }
+	if (has(content, len, "APFS") || has(content, len, "41504653")) { snprintf(out, outsz, "apfs"); return true; }
+	if (has(content, len, "HFS") || has(content, len, "Apple_HFS")) { snprintf(out, outsz, "hfs"); return true; }
+	if (has(content, len, "EFI") || has(content, len, "C12A7328")) { snprintf(out, outsz, "vfat"); return true; }
+	if (has(content, len, "GUID_partition_scheme")) { out[0] = '\0'; return true; }
+	snprintf(out, outsz, "%.*s", (int)(len < 31 ? len : 31), content);
+	return false;
+}
+
+/* Raw bytes from a data source; either malloc'd or mmap'd */
+typedef struct {
+	const char *data;
+	size_t len;
+	void *map;            /* mmap base, or NULL if data is malloc'd */
+} Blob;
+
+static void blob_release(Blob *b) {
+	if (b->map) munmap(b->map, b->len);
+	else mem_free((void *)b->data);
+	b->data = NULL;
+	b->map = NULL;
+	b->len = 0;
+}
+
+/* One mount table entry; strings are owned by the data source */
+typedef struct { const char *from, *on, *fstype; uint64_t dev; } MountEnt;   /* dev 0: unknown */
+typedef struct { MountEnt *ents; int n; Blob blob; } MountTable;
+
+static void mount_table_release(MountTable *mt) {
+	mem_free(mt->ents);
+	blob_release(&mt->blob);
+	mt->ents = NULL;
+	mt->n = 0;
+}
+
+/* Fill node from a diskutil info -plist dictionary (for -f) */
+/* Fields another source already settled (n->known) are left alone, so a
+ * column's value does not depend on which other columns pulled info in. */
+static void fill_info(Arena *a, Node *n, const Plist *pl, int info) {
+	int v;
+	v = pl_get(pl, info, "FilesystemType");
+	if (!(n->known & K_FSTYPE) && pl_is(pl, v, PL_STRING)) {
+		const char *s = arena_intern(a, pl->nodes[v].s, pl->nodes[v].len);
+		if (s) n->fstype = s;
+	}
+	v = pl_get(pl, info, "VolumeName");
+	if (!(n->known & K_LABEL) && pl_is(pl, v, PL_STRING) && pl->nodes[v].len) {
+		const char *s = plstr(a, pl, v);
+		if (s) n->label = s;
+	}
+	if (!(n->known & K_LABEL) && !n->label[0]) {
+		v = pl_get(pl, info, "MediaName");
+		if (pl_is(pl, v, PL_STRING) && pl->nodes[v].len) {
+			const char *s = plstr(a, pl, v);
+			if (s) n->label = s;
+		}
+	}
+	v = pl_get(pl, info, "VolumeUUID");
+	if (v < 0) v = pl_get(pl, info, "DiskUUID");
+	if (!(n->known & K_UUID) && v >= 0) {
+		const char *s = plstr(a, pl, v);
+		if (s) n->uuid = s;
+	}
+	v = pl_get(pl, info, "MountPoint");
+	if (pl_is(pl, v, PL_STRING) && pl->nodes[v].len) {
+		const char *s = plstr(a, pl, v);
+		if (s) n->mountpoint = s;
+	}
+}
+
+/* Called with each diskutil info -plist reply; buf is only valid during the call */
+typedef void (*InfoFn)(Node *n, const char *buf, size_t len, void *ctx);
+
+/* One in-flight diskutil info child */
+typedef struct {
+	pid_t pid;
+	int fd;
+	Node *node;
+	char *buf;
+	size_t len, cap;
+	uint64_t t0;          /* for --timing / --trace-file */
+	int slot;
+	bool failed;          /* out of memory: the reply is dropped */
+} InfoJob;
+
+/* Default --jobs: enough to hide diskutil latency, bounded so diskarbitrationd is not flooded */
+static int default_jobs(int nwork) {
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int jobs = ncpu > 0 ? (int)ncpu * 2 : 4;
+	if (jobs < 4) jobs = 4;
+	if (jobs > 16) jobs = 16;
+	if (jobs > nwork) jobs = nwork;
+	return jobs > 0 ? jobs : 1;
+}
+
+static bool info_job_start(InfoJob *j, Node *n) {
+	const char *args[] = { "info", "-plist", n->name, NULL };
+	j->t0 = span_begin();
+	j->fd = spawn_diskutil(args, &j->pid);
+	if (j->fd < 0) return false;
+	fcntl(j->fd, F_SETFL, fcntl(j->fd, F_GETFL) | O_NONBLOCK);
+	j->node = n;
+	j->len = 0;
+	j->failed = false;
+	return true;
+}
+
+/* Drain what is readable; returns true once the child closed its end */
+static bool info_job_read(InfoJob *j) {
+	for (;;) {
+		if (j->cap - j->len < 1024) {
+			size_t ncap = j->cap ? j->cap * 2 : 32768;
+			char *nb = mem_realloc(j->buf, ncap);
+			if (!nb) {
+				j->failed = true;
+				return true;
+			}
+			j->buf = nb;
+			j->cap = ncap;
+		}
+		ssize_t r = read(j->fd, j->buf + j->len, j->cap - j->len - 1);
+		if (r > 0) { j->len += (size_t)r; continue; }
+		if (r < 0 && errno == EINTR) continue;
+		if (r < 0 && errno == EAGAIN) return false;
+		return true;
+	}
+}
+
+static void info_job_finish(InfoJob *j, InfoFn fn, void *ctx) {
+	close(j->fd);
+	j->fd = -1;
+	while (waitpid(j->pid, NULL, 0) < 0 && errno == EINTR)
+		;
+	timing_spawn(j->t0);
+	trace_child(j->t0, j->slot, j->pid, j->node->name);
+	if (!j->failed) {
+		j->buf[j->len] = '\0';
+		fn(j->node, j->buf, j->len, ctx);
+	}
+	j->node = NULL;
+}
+
+/*
+ * Run diskutil info -plist for every node, at most jobs children at a time.
+ * Pipes are multiplexed with poll(); fn sees each reply as soon as it completes.
+ */
+static void fetch_info_all(Node **nodes, int n, int jobs, InfoFn fn, void *ctx) {
+	if (n <= 0) return;
+	if (jobs <= 0) jobs = default_jobs(n);
+	if (jobs > MAX_JOBS) jobs = MAX_JOBS;
+	InfoJob slots[MAX_JOBS] = { 0 };
+	struct pollfd pfds[MAX_JOBS];
+	int slot_of[MAX_JOBS];
+	int next = 0, active = 0;
+	for (int s = 0; s < jobs; s++)
+		slots[s].slot = s;
+
+	for (;;) {
+		for (int s = 0; s < jobs && next < n; s++) {
+			if (slots[s].node) continue;
+			while (next < n && !info_job_start(&slots[s], nodes[next]))
+				next++;
+			if (next >= n) break;
+			next++;
+			active++;
+		}
+		if (!active) break;
+
+		int np = 0;
+		for (int s = 0; s < jobs; s++) {
+			if (!slots[s].node) continue;
+			pfds[np].fd = slots[s].fd;
+			pfds[np].events = POLLIN;
+			pfds[np].revents = 0;
+			slot_of[np++] = s;
+		}
+		if (poll(pfds, (nfds_t)np, -1) < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		for (int i = 0; i < np; i++) {
+			if (!pfds[i].revents) continue;
+			InfoJob *j = &slots[slot_of[i]];
+			if (info_job_read(j)) {
+				info_job_finish(j, fn, ctx);
+				active--;
+			}
+		}
+	}
+	for (int s = 0; s < jobs; s++) {
+		if (slots[s].node) {
+			close(slots[s].fd);
+			waitpid(slots[s].pid, NULL, 0);
+		}
+		mem_free(slots[s].buf);
+	}
+}
+
+/*
+ * Data sources. live runs diskutil and getmntinfo(); record does the same and
+ * saves every raw reply under a directory; replay serves such a directory via
+ * mmap with no copies. On Linux, sysfs builds the nodes itself (scan) from
+ * /sys and the udev database instead of parsing diskutil output. Layout of a
+ * recording:
+ *   DIR/list.plist         diskutil list -plist
+ *   DIR/info/<dev>.plist   diskutil info -plist <dev>
+ *   DIR/mounts             from, on, fstype of each mount as NUL-terminated strings
+ *   DIR/apfs.plist         diskutil apfs list -plist (bulk APFS details for -f)
+ *   DIR/info-all.txt       diskutil info -all (--info=all)
+ */
+/* Receives diskutil list output chunk by chunk */
+typedef void (*ChunkFn)(const char *buf, size_t len, void *ctx);
+
+typedef struct NodeArray NodeArray;
+typedef struct Source Source;
+struct Source {
+	int (*list)(Source *src, ChunkFn fn, void *ctx);
+	void (*info)(Source *src, Node **nodes, int n, int jobs, InfoFn fn, void *ctx);
+	int (*mounts)(Source *src, MountTable *mt);
+	const char *dir;      /* record / replay directory */
+	int (*scan)(Source *src, NodeArray *flat);   /* instead of list, if set */
+	/* Whole output of one diskutil call (args), saved as DIR/file; NULL if unsupported */
+	int (*bulk)(Source *src, const char *const *args, const char *file, Blob *out);
+	NodeArray *flat;      /* what scan filled, for info */
+};
+
+#define LIST_CHUNK 65536
+
+/* Stream diskutil list -plist to fn as the child writes it; tee copies it to a file if >= 0 */
+static int list_stream(ChunkFn fn, void *ctx, int tee) {
+	static const char *const args[] = { "list", "-plist", NULL };
+	pid_t pid;
+	int fd = spawn_diskutil(args, &pid);
+	if (fd < 0) return -1;
+	char *buf = mem_malloc(LIST_CHUNK);
+	ssize_t r = -1;
+	while (buf) {
+		r = read(fd, buf, LIST_CHUNK);
+		if (r < 0 && errno == EINTR) continue;
+		if (r <= 0) break;
+		if (tee >= 0 && write(tee, buf, (size_t)r) != r) {
+			fprintf(stderr, "mlsblk: short write of list.plist\n");
+			tee = -1;
+		}
+		fn(buf, (size_t)r, ctx);
+	}
+	mem_free(buf);
+	close(fd);
+	int status;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	return (buf && r == 0) ? 0 : -1;
+}
+
+/* Run diskutil args to completion; out gets its malloc'd stdout */
+static int live_bulk(Source *src, const char *const *args, const char *file, Blob *out) {
+	(void)src, (void)file;
+	pid_t pid;
+	int fd = spawn_diskutil(args, &pid);
+	if (fd < 0) return -1;
+	size_t len = 0;
+	char *buf = read_all(fd, &len);
+	close(fd);
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	if (!buf || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		mem_free(buf);
+		return -1;
+	}
+	*out = (Blob){ buf, len, NULL };
+	return 0;
+}
+
+static int live_list(Source *src, ChunkFn fn, void *ctx) {
+	(void)src;
+	return list_stream(fn, ctx, -1);
+}
+
+static void live_info(Source *src, Node **nodes, int n, int jobs, InfoFn fn, void *ctx) {
+	(void)src;
+	fetch_info_all(nodes, n, jobs, fn, ctx);
+}
+
+#ifdef __APPLE__
+static int live_mounts(Source *src, MountTable *mt) {
+	(void)src;
+	struct statfs *mntbuf = NULL;
+	int count = getmntinfo(&mntbuf, MNT_NOWAIT);
+	*mt = (MountTable){ 0 };
+	if (count <= 0 || !mntbuf) return 0;
+	mt->ents = mem_calloc((size_t)count, sizeof(MountEnt));
+	if (!mt->ents) return -1;
+	for (int i = 0; i < count; i++)
+		mt->ents[i] = (MountEnt){ mntbuf[i].f_mntfromname, mntbuf[i].f_mntonname, mntbuf[i].f_fstypename };
+	mt->n = count;
+	return 0;
+}
+#else
+/* Undo the \ooo escapes of a /proc/self/mounts field in place */
+static char *mounts_field(char **pp) {
+	char *f = *pp, *o = f, *p = f;
+	for (; *p && *p != ' ' && *p != '\n'; p++) {
+		if (p[0] == '\\' && p[1] >= '0' && p[1] <= '3' && p[2] >= '0' && p[2] <= '7' && p[3] >= '0' && p[3] <= '7') {
+			*o++ = (char)((p[1] - '0') << 6 | (p[2] - '0') << 3 | (p[3] - '0'));
+			p += 3;
+		} else
+			*o++ = *p;
+	}
+	*pp = *p ? p + 1 : p;
+	*o = '\0';
+	return f;
+}
+
+/* MLSBLK_SYSROOT is prepended to /sys, /proc and /run, so fixtures can stand in for a host */
+static const char *sys_root(void) {
+	const char *r = getenv("MLSBLK_SYSROOT");
+	return r ? r : "";
+}
+
+/*
+ * /proc/self/mountinfo, split in place. Per line: "id parent major:minor root
+ * mountpoint options [optional fields...] - fstype source superoptions".
+ */
+static int live_mounts(Source *src, MountTable *mt) {
+	(void)src;
+	*mt = (MountTable){ 0 };
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/proc/self/mountinfo", sys_root());
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return 0;
+	size_t len = 0;
+	char *buf = read_all(fd, &len);
+	close(fd);
+	if (!buf) return -1;
+	mt->blob = (Blob){ buf, len, NULL };
+	int lines = 0;
+	for (size_t i = 0; i < len; i++)
+		lines += (buf[i] == '\n');
+	mt->ents = mem_calloc((size_t)lines + 1, sizeof(MountEnt));
+	if (!mt->ents) return -1;
+	for (char *p = buf; *p && mt->n <= lines;) {
+		char *eol = strchr(p, '\n');
+		if (eol) *eol = '\0';
+		MountEnt *e = &mt->ents[mt->n];
+		unsigned maj, min;
+		mounts_field(&p);
+		mounts_field(&p);
+		if (sscanf(mounts_field(&p), "%u:%u", &maj, &min) == 2) e->dev = makedev(maj, min);
+		mounts_field(&p);
+		e->on = mounts_field(&p);
+		mounts_field(&p);
+		while (*p && strcmp(mounts_field(&p), "-") != 0)
+			;
+		e->fstype = mounts_field(&p);
+		e->from = mounts_field(&p);
+		if (e->on[0]) mt->n++;
+		p = eol ? eol + 1 : p + strlen(p);
+	}
+	return 0;
+}
+#endif
+
+static int write_file(const char *dir, const char *rel, const char *data, size_t len) {
+	char path[PATH_MAX];
+	if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, rel) >= sizeof(path)) return -1;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return -1;
+	while (len > 0) {
+		ssize_t w = write(fd, data, len);
+		if (w < 0 && errno == EINTR) continue;
+		if (w <= 0) { close(fd); return -1; }
+		data += w;
+		len -= (size_t)w;
+	}
+	return close(fd);
+}
+
+/* mmap dir/rel read-only; an empty file yields an empty blob */
+static int map_file(const char *dir, const char *rel, Blob *out) {
+	char path[PATH_MAX];
+	if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, rel) >= sizeof(path)) return -1;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	struct stat st;
+	if (fstat(fd, &st) != 0) { close(fd); return -1; }
+	*out = (Blob){ NULL, 0, NULL };
+	if (st.st_size > 0) {
+		void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) { close(fd); return -1; }
+		*out = (Blob){ p, (size_t)st.st_size, p };
+	}
+	close(fd);
+	return 0;
+}
+
+static int record_list(Source *src, ChunkFn fn, void *ctx) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/list.plist", src->dir);
+	int tee = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (tee < 0)
+		fprintf(stderr, "mlsblk: cannot write %s: %s\n", path, strerror(errno));
+	int rc = list_stream(fn, ctx, tee);
+	if (tee >= 0) close(tee);
+	return rc;
+}
+
+typedef struct { Source *src; InfoFn fn; void *ctx; } RecordCtx;
+
+static void record_info_one(Node *n, const char *buf, size_t len, void *ctx) {
+	RecordCtx *rc = ctx;
+	char rel[PATH_MAX];
+	snprintf(rel, sizeof(rel), "info/%s.plist", n->name);
+	if (!strchr(n->name, '/') && write_file(rc->src->dir, rel, buf, len) != 0)
+		fprintf(stderr, "mlsblk: cannot write %s/%s: %s\n", rc->src->dir, rel, strerror(errno));
+	rc->fn(n, buf, len, rc->ctx);
+}
+
+static void record_info(Source *src, Node **nodes, int n, int jobs, InfoFn fn, void *ctx) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/info", src->dir);
+	if (mkdir(path, 0755) != 0 && errno != EEXIST)
+		fprintf(stderr, "mlsblk: cannot create %s: %s\n", path, strerror(errno));
+	RecordCtx rc = { src, fn, ctx };
+	fetch_info_all(nodes, n, jobs, record_info_one, &rc);
+}
+
+static int record_mounts(Source *src, MountTable *mt) {
+	if (live_mounts(src, mt) != 0) return -1;
+	size_t len = 0;
+	for (int i = 0; i < mt->n; i++)
+		len += strlen(mt->ents[i].from) + strlen(mt->ents[i].on) + strlen(mt->ents[i].fstype) + 3;
+	char *buf = mem_malloc(len ? len : 1), *p = buf;
+	if (!buf) return 0;
+	for (int i = 0; i < mt->n; i++) {
+		const char *f[3] = { mt->ents[i].from, mt->ents[i].on, mt->ents[i].fstype };
+		for (int k = 0; k < 3; k++) {
+			size_t l = strlen(f[k]) + 1;
+			memcpy(p, f[k], l);
+			p += l;
+		}
+	}
+	if (write_file(src->dir, "mounts", buf, len) != 0)
+		fprintf(stderr, "mlsblk: cannot write %s/mounts: %s\n", src->dir, strerror(errno));
+	mem_free(buf);
+	return 0;
+}
+
+static int record_bulk(Source *src, const char *const *args, const char *file, Blob *out) {
+	if (live_bulk(src, args, file, out) != 0) return -1;
+	if (write_file(src->dir, file, out->data, out->len) != 0)
+		fprintf(stderr, "mlsblk: cannot write %s/%s: %s\n", src->dir, file, strerror(errno));
+	return 0;
+}
+
+static int replay_bulk(Source *src, const char *const *args, const char *file, Blob *out) {
+	(void)args;
+	return map_file(src->dir, file, out);
+}
+
+static int replay_list(Source *src, ChunkFn fn, void *ctx) {
+	Blob b;
+	if (map_file(src->dir, "list.plist", &b) != 0) return -1;
+	fn(b.data, b.len, ctx);
+	blob_release(&b);
+	return 0;
+}
+
+static void replay_info(Source *src, Node **nodes, int n, int jobs, InfoFn fn, void *ctx) {
+	(void)jobs;
+	char rel[PATH_MAX];
+	for (int i = 0; i < n; i++) {
+		Blob b;
+		snprintf(rel, sizeof(rel), "info/%s.plist", nodes[i]->name);
+		uint64_t t = span_begin();
+		if (strchr(nodes[i]->name, '/') || map_file(src->dir, rel, &b) != 0) continue;
+		fn(nodes[i], b.data, b.len, ctx);
+		blob_release(&b);
+		trace_child(t, 0, 0, nodes[i]->name);
+	}
+}
+
+static int replay_mounts(Source *src, MountTable *mt) {
+	*mt = (MountTable){ 0 };
+	if (map_file(src->dir, "mounts", &mt->blob) != 0) return 0;
+	const char *p = mt->blob.data, *end = p + mt->blob.len;
+	int n = 0;
+	for (const char *q = p; q < end; q++)
+		n += (*q == '\0');
+	if (end > p && end[-1] != '\0') {
+		fprintf(stderr, "mlsblk: %s/mounts: truncated record\n", src->dir);
+		return 0;
+	}
+	mt->ents = mem_calloc((size_t)(n / 3) + 1, sizeof(MountEnt));
+	if (!mt->ents) return -1;
+	while (mt->n < n / 3) {
+		MountEnt *e = &mt->ents[mt->n++];
+		e->from = p; p += strlen(p) + 1;
+		e->on = p; p += strlen(p) + 1;
+		e->fstype = p; p += strlen(p) + 1;
+	}
+	return 0;
+}
+
+/* InfoFn: parse a diskutil info -plist reply into the node; ctx is the node arena */
+static void fill_info_reply(Node *n, const char *buf, size_t len, void *ctx) {
+	uint64_t t = phase_begin(PH_INFO_PARSE);
+	Plist pl;
+	if (plist_parse(&pl, buf, len) == 0) {
+		fill_info(ctx, n, &pl, pl.root);
+		plist_free(&pl);
+	}
+	n->known |= K_INFO;
+	phase_end(PH_INFO_PARSE, t);
+}
+
+/*
+ * All nodes in creation order; the tree shares them and arena owns them.
+ * slots is an open-addressing (linear probing) index of arr by name, kept
+ * at most half full, so lookups and ensure_node() are O(1).
+ */
+struct NodeArray {
+	Arena arena;
+	Node **roots;         /* top-level disks, in the arena */
+	int nroots, cap_roots;
+	Node **arr;
+	int n, cap;
+	int *slots;           /* index into arr, -1 if empty */
+	uint32_t mask;        /* slot count - 1 (power of two) */
+};
+
+static Node *node_lookup(const NodeArray *flat, const char *name, uint32_t h) {
+	if (!flat->slots) return NULL;
+	for (uint32_t i = h & flat->mask;; i = (i + 1) & flat->mask) {
+		int k = flat->slots[i];
+		if (k < 0) return NULL;
+		if (flat->arr[k]->hash == h && strcmp(flat->arr[k]->name, name) == 0)
+			return flat->arr[k];
+	}
+}
+
+static int node_index_grow(NodeArray *flat) {
+	uint32_t nslots = flat->slots ? (flat->mask + 1) * 2 : 128;
+	int *slots = mem_malloc(nslots * sizeof(int));
+	if (!slots) return -1;
+	memset(slots, 0xff, nslots * sizeof(int));
+	for (int k = 0; k < flat->n; k++) {
+		uint32_t i = flat->arr[k]->hash & (nslots - 1);
+		while (slots[i] >= 0)
+			i = (i + 1) & (nslots - 1);
+		slots[i] = k;
+	}
+	mem_free(flat->slots);
+	flat->slots = slots;
+	flat->mask = nslots - 1;
+	return 0;
+}
+
+static Node *ensure_node(NodeArray *flat, const char *name, uint64_t size, const char *type) {
+	uint32_t h = name_hash(name);
+	Node *found = node_lookup(flat, name, h);
+	if (found) return found;
+	if ((uint32_t)(flat->n + 1) * 2 > (flat->slots ? flat->mask + 1 : 0) && node_index_grow(flat) != 0)
+		return NULL;
+	Node *n = node_create(&flat->arena, name, size, type);
+	if (!n) return NULL;
+	if (flat->n >= flat->cap) {
+		int newcap = flat->cap ? flat->cap * 2 : 64;
+		Node **p = mem_realloc(flat->arr, (size_t)newcap * sizeof(Node *));
+		if (!p) return NULL;
+		flat->arr = p;
+		flat->cap = newcap;
+	}
+	uint32_t i = h & flat->mask;
+	while (flat->slots[i] >= 0)
+		i = (i + 1) & flat->mask;
+	flat->slots[i] = flat->n;
+	flat->arr[flat->n++] = n;
+	return n;
+}
+
+static int node_array_add_root(NodeArray *flat, Node *n) {
+	if (flat->nroots >= flat->cap_roots) {
+		Node **r = arena_grow(&flat->arena, flat->roots, flat->nroots, &flat->cap_roots, sizeof(Node *));
+		if (!r) return -1;
+		flat->roots = r;
+	}
+	flat->roots[flat->nroots++] = n;
+	return 0;
+}
+
+static void node_array_sort(NodeArray *flat) {
+	for (int i = 0; i < flat->nroots; i++)
+		sort_children(flat->roots[i]);
+	qsort(flat->roots, (size_t)flat->nroots, sizeof(Node *), node_cmp);
+}
+
+/* Frees every node and string at once */
+static void node_array_free(NodeArray *flat) {
+	arena_release(&flat->arena);
+	mem_free(flat->arr);
+	mem_free(flat->slots);
+	*flat = (NodeArray){ 0 };
+}
+
+static void node_add_mount(Arena *a, Node *n, const char *target) {
+	const char *s = arena_strndup(a, target, strlen(target));
+	if (!s) return;
+	if (n->nmounts >= n->cap_mounts) {
+		const char **m = arena_grow(a, n->mounts, n->nmounts, &n->cap_mounts, sizeof(char *));
+		if (!m) return;
+		n->mounts = m;
+	}
+	n->mounts[n->nmounts++] = s;
+	n->mountpoint = s;
+}
+
+/*
+ * Join the mount table onto the nodes, one hash lookup per mount: by device
+ * number into a dev_t index of the nodes when the mount has one (mountinfo's
+ * major:minor), else by the /dev/ name. Sources that still do not match,
+ * such as /dev/mapper/... or /dev/disk/by-uuid/... links, are stat()ed for
+ * st_rdev, once per distinct path, unless stat_sources is off (replay: the
+ * paths belong to another host).
+ */
+typedef struct {
+	uint64_t *devs;
+	Node **nodes;
+	uint32_t mask;        /* 0 when no node has a device number */
+} DevIndex;
+
+static uint32_t dev_hash(uint64_t dev) {
+	return (uint32_t)((dev * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static int dev_index_init(DevIndex *ix, const NodeArray *flat) {
+	*ix = (DevIndex){ 0 };
+	uint32_t n = 0, nslots = 16;
+	for (int i = 0; i < flat->n; i++)
+		n += flat->arr[i]->dev != 0;
+	if (!n) return 0;
+	while (nslots < n * 2)
+		nslots *= 2;
+	ix->devs = mem_calloc(nslots, sizeof(uint64_t));
+	ix->nodes = mem_malloc(nslots * sizeof(Node *));
+	if (!ix->devs || !ix->nodes) return -1;
+	ix->mask = nslots - 1;
+	for (int i = 0; i < flat->n; i++) {
+		uint64_t dev = flat->arr[i]->dev;
+		if (!dev) continue;
+		uint32_t k = dev_hash(dev) & ix->mask;
+		while (ix->devs[k] && ix->devs[k] != dev)
+			k = (k + 1) & ix->mask;
+		ix->devs[k] = dev;
+		ix->nodes[k] = flat->arr[i];
+	}
+	return 0;
+}
+
+static Node *dev_lookup(const DevIndex *ix, uint64_t dev) {
+	if (!ix->mask || !dev) return NULL;
+	for (uint32_t k = dev_hash(dev) & ix->mask; ix->devs[k]; k = (k + 1) & ix->mask)
+		if (ix->devs[k] == dev) return ix->nodes[k];
+	return NULL;
+}
+
+/* st_rdev of each distinct mount source, 0 if it is not a block device */
+typedef struct {
+	const char **paths;
+	uint64_t *devs;
+	uint32_t mask;
+} StatCache;
+
+static uint64_t stat_cached(StatCache *sc, const char *path) {
+	uint32_t k = name_hash(path) & sc->mask;
+	for (; sc->paths[k]; k = (k + 1) & sc->mask)
+		if (strcmp(sc->paths[k], path) == 0) return sc->devs[k];
+	struct stat st;
+	uint64_t dev = stat(path, &st) == 0 && S_ISBLK(st.st_mode) ? (uint64_t)st.st_rdev : 0;
+	sc->paths[k] = path;
+	sc->devs[k] = dev;
+	return dev;
+}
+
+static void fill_mountpoints(NodeArray *flat, const MountTable *mt, bool stat_sources) {
+	DevIndex ix;
+	StatCache sc = { 0 };
+	uint32_t nslots = 16;
+	while (nslots < (uint32_t)mt->n * 2)
+		nslots *= 2;
+	if (dev_index_init(&ix, flat) != 0) stat_sources = false;
+	if (stat_sources) {
+		sc.paths = mem_calloc(nslots, sizeof(char *));
+		sc.devs = mem_malloc(nslots * sizeof(uint64_t));
+		sc.mask = nslots - 1;
+		if (!sc.paths || !sc.devs) stat_sources = false;
+	}
+	for (int i = 0; i < mt->n; i++) {
+		const char *from = mt->ents[i].from;
+		const char *target = mt->ents[i].on;
+		if (!from || !target) continue;
+		Node *n = dev_lookup(&ix, mt->ents[i].dev);
+		if (!n && strncmp(from, "/dev/", 5) == 0)
+			n = node_lookup(flat, from + 5, name_hash(from + 5));
+		if (!n && stat_sources && from[0] == '/') {
+			uint64_t dev = stat_cached(&sc, from);
+			n = dev_lookup(&ix, dev);
+#ifdef __APPLE__
+			/* diskutil nodes carry no dev_t: back to a name via the devfs */
+			const char *name = !n && dev ? devname((dev_t)dev, S_IFBLK) : NULL;
+			if (name) n = node_lookup(flat, name, name_hash(name));
+#endif
+		}
+		if (!n) continue;
+		node_add_mount(&flat->arena, n, target);
+		const char *fs = mt->ents[i].fstype;
+		if (!(n->known & K_FSTYPE) && fs && fs[0]) {
+			n->fstype = arena_intern(&flat->arena, fs, strlen(fs));
+			n->known |= K_FSTYPE;
+		}
+	}
+	mem_free(ix.devs);
+	mem_free(ix.nodes);
+	mem_free(sc.paths);
+	mem_free(sc.devs);
+}
+
+/*
+ * diskutil apfs list -plist: one call describes every container, its
+ * physical stores and volumes. Nodes found here get FSTYPE, LABEL, UUID,
+ * ROLE, ENCRYPTED and FSUSED and are marked known, so -f spawns no
+ * diskutil info for them. Containers are the exception: their LABEL (the
+ * media name) still comes from diskutil info.
+ */
+static const char *const apfs_args[] = { "apfs", "list", "-plist", NULL };
+
+static uint64_t pl_uint(const Plist *pl, int dict, const char *key) {
+	int v = pl_get(pl, dict, key);
+	return pl_is(pl, v, PL_INTEGER) ? parse_int(pl->nodes[v].s, pl->nodes[v].len) : 0;
+}
+
+static Node *apfs_node(NodeArray *flat, const Plist *pl, int dict) {
+	int v = pl_get(pl, dict, "DeviceIdentifier");
+	if (v < 0) v = pl_get(pl, dict, "ContainerReference");
+	if (!pl_is(pl, v, PL_STRING) || pl->nodes[v].len >= 64) return NULL;
+	char name[64];
+	memcpy(name, pl->nodes[v].s, pl->nodes[v].len);
+	name[pl->nodes[v].len] = '\0';
+	return node_lookup(flat, name, name_hash(name));
+}
+
+static void apfs_fill_volume(NodeArray *flat, const Plist *pl, int vol) {
+	Node *n = apfs_node(flat, pl, vol);
+	if (!n) return;
+	Arena *a = &flat->arena;
+	const char *s;
+	n->fstype = arena_intern(a, "apfs", 4);
+	int v = pl_get(pl, vol, "Name");
+	if (pl_is(pl, v, PL_STRING) && pl->nodes[v].len && (s = plstr(a, pl, v))) n->label = s;
+	if ((s = plstr(a, pl, pl_get(pl, vol, "APFSVolumeUUID")))) n->uuid = s;
+	v = pl_get(pl, vol, "Encryption");
+	if (pl_is(pl, v, PL_TRUE)) n->encrypted = arena_intern(a, "yes", 3);
+	else if (pl_is(pl, v, PL_FALSE)) n->encrypted = arena_intern(a, "no", 2);
+	n->fsused = pl_uint(pl, vol, "CapacityInUse");
+	v = pl_get(pl, vol, "Roles");
+	if (pl_is(pl, v, PL_ARRAY)) {
+		char roles[256];
+		size_t len = 0;
+		for (int r = pl->nodes[v].child; r >= 0; r = pl->nodes[r].next) {
+			const PlNode *e = &pl->nodes[r];
+			if (e->type != PL_STRING || len + e->len + 2 > sizeof(roles)) continue;
+			if (len) roles[len++] = ',';
+			memcpy(roles + len, e->s, e->len);
+			len += e->len;
+		}
+		n->role = arena_intern(a, roles, len);
+	}
+	n->known |= K_INFO | K_APFS;
+}
+
+static void apfs_fill(NodeArray *flat, const Blob *b) {
+	Plist pl;
+	if (plist_parse(&pl, b->data, b->len) != 0) return;
+	int list = pl_get(&pl, pl.root, "Containers");
+	for (int c = pl_is(&pl, list, PL_ARRAY) ? pl.nodes[list].child : -1; c >= 0; c = pl.nodes[c].next) {
+		Arena *a = &flat->arena;
+		Node *n = apfs_node(flat, &pl, c);
+		if (n) {
+			const char *s = plstr(a, &pl, pl_get(&pl, c, "APFSContainerUUID"));
+			if (s) n->uuid = s;
+			n->fstype = arena_intern(a, "apfs", 4);
+			uint64_t ceiling = pl_uint(&pl, c, "CapacityCeiling"), avail = pl_uint(&pl, c, "CapacityFree");
+			n->fsused = ceiling > avail ? ceiling - avail : 0;
+			/* LABEL is the container's media name, which only diskutil info has */
+			n->known |= K_FSTYPE | K_UUID | K_APFS;
+		}
+		int stores = pl_get(&pl, c, "PhysicalStores");
+		for (int d = pl_is(&pl, stores, PL_ARRAY) ? pl.nodes[stores].child : -1; d >= 0; d = pl.nodes[d].next) {
+			Node *st = apfs_node(flat, &pl, d);
+			if (!st) continue;
+			const char *s = plstr(a, &pl, pl_get(&pl, d, "DiskUUID"));
+			st->fstype = arena_intern(a, "apfs", 4);
+			st->known |= K_FSTYPE;
+			if (s) {
+				st->uuid = s;
+				st->known |= K_INFO;
+			}
+		}
+		int vols = pl_get(&pl, c, "Volumes");
+		for (int v = pl_is(&pl, vols, PL_ARRAY) ? pl.nodes[vols].child : -1; v >= 0; v = pl.nodes[v].next)
+			apfs_fill_volume(flat, &pl, v);
+	}
+	plist_free(&pl);
+}
+
+/*
+ * diskutil info -all (--info=all): the text form of every device's diskutil
+ * info in one call. Records are separated by a line of asterisks; each line
+ * is "   Key:   value". Lines are scanned with memchr straight from the blob,
+ * and only the keys that match fill_info()'s plist keys are kept. Each record
+ * is matched to its node by Device Identifier and marks its fields known.
+ */
+static const char *const info_all_args[] = { "info", "-all", NULL };
+
+enum { IA_DEVICE, IA_FSTYPE, IA_VOLNAME, IA_MEDIANAME, IA_VOLUUID, IA_DISKUUID, IA_MOUNT, IA_MAX };
+
+static const struct { const char *key; size_t len; } ia_keys[IA_MAX] = {
+#define IA_KEY(s) { s, sizeof(s) - 1 }
+	[IA_DEVICE] = IA_KEY("Device Identifier"),
+	[IA_FSTYPE] = IA_KEY("Type (Bundle)"),             /* FilesystemType */
+	[IA_VOLNAME] = IA_KEY("Volume Name"),              /* VolumeName */
+	[IA_MEDIANAME] = IA_KEY("Device / Media Name"),    /* MediaName */
+	[IA_VOLUUID] = IA_KEY("Volume UUID"),              /* VolumeUUID */
+	[IA_DISKUUID] = IA_KEY("Disk / Partition UUID"),   /* DiskUUID */
+	[IA_MOUNT] = IA_KEY("Mount Point"),                /* MountPoint */
+#undef IA_KEY
+};
+
+/* One record's values; s is NULL for a key that was absent or "Not applicable" */
+typedef struct { const char *s; size_t len; } IaField;
+
+static void info_all_record(NodeArray *flat, const IaField *f) {
+	if (!f[IA_DEVICE].len || f[IA_DEVICE].len >= 64) return;
+	char name[64];
+	memcpy(name, f[IA_DEVICE].s, f[IA_DEVICE].len);
+	name[f[IA_DEVICE].len] = '\0';
+	Node *n = node_lookup(flat, name, name_hash(name));
+	if (!n || (n->known & K_INFO) == K_INFO) return;
+	Arena *a = &flat->arena;
+	const char *s;
+	if (!(n->known & K_FSTYPE) && f[IA_FSTYPE].s && (s = arena_intern(a, f[IA_FSTYPE].s, f[IA_FSTYPE].len)))
+		n->fstype = s;
+	const IaField *label = f[IA_VOLNAME].len ? &f[IA_VOLNAME] : n->label[0] ? NULL : &f[IA_MEDIANAME];
+	if (!(n->known & K_LABEL) && label && label->len && (s = arena_strndup(a, label->s, label->len)))
+		n->label = s;
+	const IaField *uuid = f[IA_VOLUUID].s ? &f[IA_VOLUUID] : &f[IA_DISKUUID];
+	if (!(n->known & K_UUID) && uuid->s && (s = arena_strndup(a, uuid->s, uuid->len))) n->uuid = s;
+	if (f[IA_MOUNT].len && (s = arena_strndup(a, f[IA_MOUNT].s, f[IA_MOUNT].len))) n->mountpoint = s;
+	n->known |= K_INFO;
+}
+
+static void info_all_fill(NodeArray *flat, const Blob *b) {
+	IaField f[IA_MAX] = { 0 };
+	const char *p = b->data, *end = p + b->len;
+	while (p < end) {
+		const char *eol = memchr(p, '\n', (size_t)(end - p));
+		if (!eol) eol = end;
+		while (p < eol && (*p == ' ' || *p == '\t'))
+			p++;
+		const char *colon = p < eol && *p != '*' ? memchr(p, ':', (size_t)(eol - p)) : NULL;
+		if (p < eol && *p == '*') {
+			info_all_record(flat, f);
+			memset(f, 0, sizeof(f));
+		}
+		for (int k = 0; colon && k < IA_MAX; k++) {
+			if ((size_t)(colon - p) != ia_keys[k].len || memcmp(p, ia_keys[k].key, ia_keys[k].len) != 0)
+				continue;
+			const char *v = colon + 1, *ve = eol;
+			while (v < ve && *v == ' ')
+				v++;
+			while (ve > v && (ve[-1] == ' ' || ve[-1] == '\r'))
+				ve--;
+			if ((size_t)(ve - v) < 14 || memcmp(v, "Not applicable", 14) != 0)
+				f[k] = (IaField){ v, (size_t)(ve - v) };
+			break;
+		}
+		p = eol + 1;
+	}
+	info_all_record(flat, f);
+}
+
+#ifdef __linux__
+/*
+ * Linux source: the tree straight from sysfs, with no child processes. Each
+ * entry of /sys/class/block is read with openat() below one cached directory
+ * fd and a single pread() per attribute into a stack buffer: size (512-byte
+ * sectors), dev (major:minor), partition (present for partitions) and
+ * slaves/ (what a dm or md device is stacked on). A partition's disk is the
+ * directory above it in the class link. dm devices are shown by their
+ * mapper name (dm/name), as lsblk does. Ram disks (major 1) and empty
+ * devices are left out, as lsblk does.
+ */
+/* strlcpy: copy s into out, truncated to cap - 1 bytes */
+static void sys_copy(char *out, size_t cap, const char *s) {
+	size_t n = strlen(s);
+	if (n >= cap) n = cap - 1;
+	memcpy(out, s, n);
+	out[n] = '\0';
+}
+
+static int sys_open_dir(int dirfd, const char *rel) {
+	return openat(dirfd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/* One attribute into buf, trailing newline dropped; length or -1 */
+static int sys_attr(int dirfd, const char *rel, char *buf, size_t cap) {
+	int fd = openat(dirfd, rel, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	ssize_t r = pread(fd, buf, cap - 1, 0);
+	close(fd);
+	if (r < 0) return -1;
+	while (r > 0 && (buf[r - 1] == '\n' || buf[r - 1] == ' '))
+		r--;
+	buf[r] = '\0';
+	return (int)r;
+}
+
+/* TYPE as lsblk prints it: part, disk, loop, rom, raidN, lvm, crypt, dm, ... */
+static void sys_type(int devfd, const char *name, bool part, char *type, size_t cap) {
+	char buf[128];
+	snprintf(type, cap, "disk");
+	if (part)
+		snprintf(type, cap, "part");
+	else if (strncmp(name, "loop", 4) == 0)
+		snprintf(type, cap, "loop");
+	else if (strncmp(name, "sr", 2) == 0)
+		snprintf(type, cap, "rom");
+	else if (sys_attr(devfd, "md/level", buf, sizeof(buf)) > 0)
+		sys_copy(type, cap, buf);
+	else if (sys_attr(devfd, "dm/uuid", buf, sizeof(buf)) > 0) {
+		/* as lsblk: "LVM-...", "CRYPT-LUKS2-...", "mpath-...": the uuid up to
+		 * its first '-', lowercased; kpartx's "part1-..." is just "part" */
+		size_t i = 0;
+		for (; buf[i] && buf[i] != '-' && i + 1 < cap; i++)
+			type[i] = (char)(buf[i] >= 'A' && buf[i] <= 'Z' ? buf[i] + 32 : buf[i]);
+		type[i] = '\0';
+		if (strncmp(type, "part", 4) == 0) type[4] = '\0';
+	} else if (faccessat(devfd, "dm", F_OK, 0) == 0)
+		snprintf(type, cap, "dm");    /* no uuid */
+}
+
+/* First of a device's slaves/ in name order, into out; false if it has none.
+ * This is the device's only parent; lsblk repeats it under every slave. */
+static bool sys_first_slave(int devfd, char *out, size_t cap) {
+	int fd = sys_open_dir(devfd, "slaves");
+	if (fd < 0) return false;
+	DIR *d = fdopendir(fd);
+	if (!d) { close(fd); return false; }
+	out[0] = '\0';
+	struct dirent *e;
+	while ((e = readdir(d)))
+		if (e->d_name[0] != '.' && (!out[0] || name_cmp(e->d_name, out) < 0))
+			sys_copy(out, cap, e->d_name);
+	closedir(d);
+	return out[0] != '\0';
+}
+
+/* Parent kernel name of a partition: ".../block/sda/sda1" -> "sda" */
+static bool sys_part_parent(int classfd, const char *name, char *out, size_t cap) {
+	char link[PATH_MAX];
+	ssize_t r = readlinkat(classfd, name, link, sizeof(link) - 1);
+	if (r <= 0) return false;
+	link[r] = '\0';
+	char *last = strrchr(link, '/');
+	if (!last) return false;
+	*last = '\0';
+	char *prev = strrchr(link, '/');
+	sys_copy(out, cap, prev ? prev + 1 : link);
+	return true;
+}
+
+/* A device to fix up after the scan: its parent, and for dm its mapper name */
+typedef struct { Node *node; char parent[64]; char rename[128]; } SysLink;
+
+static int sysfs_scan(Source *src, NodeArray *flat) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/sys/class/block", sys_root());
+	int classfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (classfd < 0) return -1;
+	int dupfd = dup(classfd);
+	DIR *d = dupfd >= 0 ? fdopendir(dupfd) : NULL;
+	if (!d) {
+		if (dupfd >= 0) close(dupfd);
+		close(classfd);
+		return -1;
+	}
+	src->flat = flat;
+	SysLink *links = NULL;
+	int nlinks = 0, cap = 0, rc = 0;
+	struct dirent *e;
+	while ((e = readdir(d))) {
+		const char *name = e->d_name;
+		if (name[0] == '.') continue;
+		int devfd = sys_open_dir(classfd, name);
+		if (devfd < 0) continue;
+		char buf[64], type[32];
+		unsigned maj = 0, min = 0;
+		uint64_t sectors = 0;
+		if (sys_attr(devfd, "dev", buf, sizeof(buf)) > 0) sscanf(buf, "%u:%u", &maj, &min);
+		if (sys_attr(devfd, "size", buf, sizeof(buf)) > 0) sectors = strtoull(buf, NULL, 10);
+		bool part = faccessat(devfd, "partition", F_OK, 0) == 0;
+		if (maj == 1 || sectors == 0) {
+			close(devfd);
+			continue;
+		}
+		SysLink l = { 0 };
+		bool linked = part ? sys_part_parent(classfd, name, l.parent, sizeof(l.parent))
+			: sys_first_slave(devfd, l.parent, sizeof(l.parent));
+		bool renamed = !part && sys_attr(devfd, "dm/name", l.rename, sizeof(l.rename)) > 0;
+		sys_type(devfd, name, part, type, sizeof(type));
+		close(devfd);
+		Node *n = ensure_node(flat, name, sectors * 512, type);
+		if (!n) { rc = -1; break; }
+		n->dev = makedev(maj, min);
+		if (!linked && !renamed) continue;
+		if (nlinks == cap) {
+			cap = cap ? cap * 2 : 64;
+			SysLink *p = mem_realloc(links, (size_t)cap * sizeof(SysLink));
+			if (!p) { rc = -1; break; }
+			links = p;
+		}
+		l.node = n;
+		links[nlinks++] = l;
+	}
+	closedir(d);
+	close(classfd);
+	/* Parents only once every device exists, as readdir order is arbitrary */
+	bool renamed = false;
+	for (int i = 0; rc == 0 && i < nlinks; i++) {
+		Node *p = links[i].parent[0] ? node_lookup(flat, links[i].parent, name_hash(links[i].parent)) : NULL;
+		if (p && p != links[i].node) node_add_child(&flat->arena, p, links[i].node);
+	}
+	for (int i = 0; rc == 0 && i < nlinks; i++) {
+		Node *n = links[i].node;
+		const char *r = links[i].rename;
+		if (!r[0] || !(n->name = arena_strndup(&flat->arena, r, strlen(r)))) continue;
+		n->hash = name_hash(r);
+		n->key = sort_key(r);
+		renamed = true;
+	}
+	mem_free(links);
+	if (rc == 0 && renamed && node_index_grow(flat) != 0) rc = -1;   /* rehash under the new names */
+	for (int i = 0; rc == 0 && i < flat->n; i++)
+		if (!flat->arr[i]->parent && node_array_add_root(flat, flat->arr[i]) != 0) rc = -1;
+	return rc;
+}
+
+static int hex_nibble(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/* Decode udev's \xHH escapes (ID_FS_LABEL_ENC) in place; a malformed one is kept as is */
+static void udev_unescape(char *s) {
+	char *o = s;
+	for (; *s; s++) {
+		int hi, lo;
+		if (s[0] == '\\' && s[1] == 'x' && (hi = hex_nibble(s[2])) >= 0 && (lo = hex_nibble(s[3])) >= 0) {
+			*o++ = (char)(hi << 4 | lo);
+			s += 3;
+		} else
+			*o++ = *s;
+	}
+	*o = '\0';
+}
+
+/* -f on sysfs: FSTYPE, LABEL and UUID from the udev database, b<major>:<minor> */
+static void sysfs_info(Source *src, Node **nodes, int n, int jobs, InfoFn fn, void *ctx) {
+	(void)jobs, (void)fn, (void)ctx;
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/run/udev/data", sys_root());
+	int udevfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (udevfd < 0) return;
+	Arena *a = &src->flat->arena;
+	for (int i = 0; i < n; i++) {
+		Node *node = nodes[i];
+		unsigned had = node->known;
+		node->known |= K_INFO;    /* the udev database has all there is */
+		if (!node->dev) continue;
+		char rel[32], buf[8192];
+		snprintf(rel, sizeof(rel), "b%u:%u", major(node->dev), minor(node->dev));
+		uint64_t t = span_begin();
+		if (sys_attr(udevfd, rel, buf, sizeof(buf)) <= 0) continue;
+		bool have_enc = false;
+		for (char *line = buf, *next; line && *line; line = next) {
+			next = strchr(line, '\n');
+			if (next) *next++ = '\0';
+			if (strncmp(line, "E:ID_FS_", 8) != 0) continue;
+			char *k = line + 8, *v = strchr(k, '=');
+			if (!v) continue;
+			*v++ = '\0';
+			const char *s;
+			if (strcmp(k, "TYPE") == 0) {
+				if (!(had & K_FSTYPE) && (s = arena_intern(a, v, strlen(v)))) node->fstype = s;
+			} else if (strcmp(k, "UUID") == 0) {
+				if (!(had & K_UUID) && (s = arena_strndup(a, v, strlen(v)))) node->uuid = s;
+			} else if (strcmp(k, "LABEL_ENC") == 0) {
+				udev_unescape(v);
+				if ((s = arena_strndup(a, v, strlen(v)))) node->label = s;
+				have_enc = true;
+			} else if (strcmp(k, "LABEL") == 0 && !have_enc) {
+				if ((s = arena_strndup(a, v, strlen(v)))) node->label = s;
+			}
+		}
+		trace_child(t, 0, 0, node->name);
+	}
+	close(udevfd);
+}
+#endif
+
+static void source_init(Source *src, const char *record_dir, const char *replay_dir) {
+	if (replay_dir)
+		*src = (Source){ .list = replay_list, .info = replay_info, .mounts = replay_mounts, .dir = replay_dir,
+			.bulk = replay_bulk };
+	else if (record_dir)
+		*src = (Source){ .list = record_list, .info = record_info, .mounts = record_mounts, .dir = record_dir,
+			.bulk = record_bulk };
+#ifdef __linux__
+	else if (!getenv("MLSBLK_DISKUTIL"))
+		*src = (Source){ .info = sysfs_info, .mounts = live_mounts, .scan = sysfs_scan };
+#endif
+	else
+		*src = (Source){ .list = live_list, .info = live_info, .mounts = live_mounts, .bulk = live_bulk };
+}
+
+/*
+ * diskutil list -plist projection. Only the keys below are kept; every
+ * other value is skipped by the reader. Nodes are created as each dict
+ * closes, so the tree grows while diskutil is still writing. Key order is
+ * alphabetical (APFSVolumes before DeviceIdentifier), so children finish
+ * before their disk and wait in its pending list.
+ */
+enum ListKey { LK_NONE, LK_ALL, LK_ID, LK_SIZE, LK_CONTENT, LK_PARTS, LK_VOLS, LK_MOUNT, LK_VOLNAME, LK_VOLUUID };
+enum FrameKind { F_ROOT, F_ALL, F_DISK, F_PARTS, F_PART, F_VOLS, F_VOL };
+
+typedef struct {
+	int kind;
+	const char *id, *mount, *label, *uuid;   /* in the node arena */
+	uint64_t size;
+	const char *content;  /* NULL if absent, else fstype[] holds the mapping */
+	bool is_whole;
+	bool fstype_known;    /* content_to_fstype() was exact */
+	char fstype[64];
+	Node **pending;
+	int npending, cap;
+} ListFrame;
+
+#define LIST_MAX_DEPTH 8
+
+typedef struct {
+	PlSax sax;            /* first member: handlers cast back */
+	ListFrame stack[LIST_MAX_DEPTH];
+	int depth;
+	int key;              /* projected key whose value comes next */
+	bool seen_all;
+	NodeArray *flat;
+} ListBuilder;
+
+static const struct { int frame; const char *name; int key; } list_keys[] = {
+	{ F_ROOT, "AllDisksAndPartitions", LK_ALL },
+	{ F_DISK, "DeviceIdentifier", LK_ID }, { F_DISK, "Size", LK_SIZE }, { F_DISK, "Content", LK_CONTENT },
+	{ F_DISK, "Partitions", LK_PARTS }, { F_DISK, "APFSVolumes", LK_VOLS },
+	{ F_PART, "DeviceIdentifier", LK_ID }, { F_PART, "Size", LK_SIZE }, { F_PART, "Content", LK_CONTENT },
+	{ F_VOL, "DeviceIdentifier", LK_ID }, { F_VOL, "Size", LK_SIZE }, { F_VOL, "MountPoint", LK_MOUNT },
+	{ F_VOL, "VolumeName", LK_VOLNAME }, { F_VOL, "VolumeUUID", LK_VOLUUID },
+};
+
+static void frame_pending(ListFrame *f, Node *n) {
+	if (f->npending >= f->cap) {
+		int ncap = f->cap ? f->cap * 2 : 8;
+		Node **p = mem_realloc(f->pending, (size_t)ncap * sizeof(Node *));
+		if (!p) return;
+		f->pending = p;
+		f->cap = ncap;
+	}
+	f->pending[f->npending++] = n;
+}
+
+static void frame_release(ListFrame *f) {
+	mem_free(f->pending);
+	*f = (ListFrame){ 0 };
+}
+
+static void lb_begin(PlSax *x, int type) {
+	ListBuilder *b = (ListBuilder *)x;
+	ListFrame *top = b->depth ? &b->stack[b->depth - 1] : NULL;
+	int kind = -1;
+	if (type == PL_DICT) {
+		if (!top) kind = F_ROOT;
+		else if (top->kind == F_ALL) kind = F_DISK;
+		else if (top->kind == F_PARTS) kind = F_PART;
+		else if (top->kind == F_VOLS) kind = F_VOL;
+	} else if (top) {
+		if (b->key == LK_ALL) kind = F_ALL;
+		else if (b->key == LK_PARTS) kind = F_PARTS;
+		else if (b->key == LK_VOLS) kind = F_VOLS;
+	}
+	b->key = LK_NONE;
+	if (kind < 0 || b->depth >= LIST_MAX_DEPTH) { x->skip = 1; return; }
+	b->stack[b->depth++] = (ListFrame){ .kind = kind };
+	if (kind == F_ALL) b->seen_all = true;
+}
+
+static void lb_scalar(PlSax *x, int type, const char *s, size_t len) {
+	ListBuilder *b = (ListBuilder *)x;
+	if (!b->depth) return;
+	ListFrame *f = &b->stack[b->depth - 1];
+	if (type == PL_KEY) {
+		b->key = LK_NONE;
+		for (size_t i = 0; i < sizeof(list_keys) / sizeof(list_keys[0]); i++)
+			if (list_keys[i].frame == f->kind && strlen(list_keys[i].name) == len && memcmp(list_keys[i].name, s, len) == 0) {
+				b->key = list_keys[i].key;
+				break;
+			}
+		if (b->key == LK_NONE) x->skip_next = true;
+		return;
+	}
+	int key = b->key;
+	b->key = LK_NONE;
+	if (type == PL_INTEGER) {
+		if (key == LK_SIZE) f->size = parse_int(s, len);
+		return;
+	}
+	if (type != PL_STRING) return;
+	switch (key) {
+	case LK_ID: f->id = arena_strndup(&b->flat->arena, s, len); break;
+	case LK_MOUNT: f->mount = arena_strndup(&b->flat->arena, s, len); break;
+	case LK_VOLNAME: f->label = arena_strndup(&b->flat->arena, s, len); break;
+	case LK_VOLUUID: f->uuid = arena_strndup(&b->flat->arena, s, len); break;
+	case LK_CONTENT:
+		f->content = "";
+		f->is_whole = has(s, len, "GUID_partition_scheme") || has(s, len, "Apple_APFS_Container");
+		f->fstype_known = content_to_fstype(s, len, f->fstype, sizeof(f->fstype));
+		break;
+	default: break;
+	}
+}
+
+/* A Partitions or APFSVolumes entry closed: create it and park it on its disk */
+static void lb_child(ListBuilder *b, ListFrame *f, ListFrame *disk) {
+	if (!f->id) return;
+	Node *child = ensure_node(b->flat, f->id, f->size, "part");
+	if (!child) return;
+	Arena *a = &b->flat->arena;
+	if (f->kind == F_PART) {
+		const char *fs = f->content ? f->fstype : "";
+		child->fstype = arena_intern(a, fs, strlen(fs));
+		if (f->fstype_known) child->known |= K_FSTYPE;
+	} else {
+		if (f->mount && f->mount[0]) child->mountpoint = f->mount;
+		if (f->label && f->label[0]) child->label = f->label;
+		if (f->uuid) child->uuid = f->uuid;
+		child->fstype = arena_intern(a, "apfs", 4);
+		child->known |= K_FSTYPE | (child->label[0] ? K_LABEL : 0) | (f->uuid ? K_UUID : 0);
+	}
+	if (disk) frame_pending(disk, child);
+}
+
+/* A whole disk / container closed: create it, then attach what was pending */
+static void lb_disk(ListBuilder *b, ListFrame *f) {
+	if (!f->id) return;
+	Node *disk_node = ensure_node(b->flat, f->id, f->size, f->is_whole ? "disk" : "part");
+	if (!disk_node) return;
+	if (f->content)
+		disk_node->fstype = arena_intern(&b->flat->arena, f->fstype, strlen(f->fstype));
+	if (f->fstype_known) disk_node->known |= K_FSTYPE;
+	NodeArray *flat = b->flat;
+	if (node_array_add_root(flat, disk_node) != 0) return;
+	for (int i = 0; i < f->npending; i++)
+		node_add_child(&flat->arena, disk_node, f->pending[i]);
+}
+
+static void lb_end(PlSax *x, int type) {
+	ListBuilder *b = (ListBuilder *)x;
+	(void)type;
+	if (!b->depth) return;
+	ListFrame *f = &b->stack[--b->depth];
+	ListFrame *parent = b->depth >= 2 ? &b->stack[b->depth - 2] : NULL;
+	if (f->kind == F_PART || f->kind == F_VOL)
+		lb_child(b, f, parent && parent->kind == F_DISK ? parent : NULL);
+	else if (f->kind == F_DISK)
+		lb_disk(b, f);
+	frame_release(f);
+	b->key = LK_NONE;
+}
+
+static void list_builder_init(ListBuilder *b, NodeArray *flat) {
+	*b = (ListBuilder){ .flat = flat };
+	sax_init(&b->sax);
+	b->sax.begin = lb_begin;
+	b->sax.end = lb_end;
+	b->sax.scalar = lb_scalar;
+	*flat = (NodeArray){ 0 };
+}
+
+/* ChunkFn: feed diskutil list output as it arrives */
+static void list_builder_feed(const char *buf, size_t len, void *ctx) {
+	ListBuilder *b = ctx;
+	uint64_t t = phase_begin(PH_PARSE);
+	if (!b->sax.error) sax_feed(&b->sax, buf, len);
+	phase_end(PH_PARSE, t);
+}
+
+/* End of input: sort roots and each level of children */
+static int list_builder_finish(ListBuilder *b) {
+	bool ok = !b->sax.error && b->seen_all && b->depth == 0;
+	while (b->depth)
+		frame_release(&b->stack[--b->depth]);
+	sax_free(&b->sax);
+	if (!ok) return -1;
+	node_array_sort(b->flat);
+	return 0;
+}
+
+/*
+ * Frozen, print-ready form of the tree: one array in sorted pre-order with
+ * 32-bit links, and all strings as offsets into one pool (offset 0 is "").
+ * A node's first child, if any, is the next entry, so the list printer is a
+ * plain linear scan. Roots are chained from entry 0 through next_sibling.
+ */
+#define NT_NONE UINT32_MAX
+
+typedef struct {
+	uint64_t size, fsused;
+	uint32_t name, type, mountpoint, fstype, label, uuid, role, encrypted;   /* pool offsets */
+	uint32_t mounts, nmounts;       /* range of NodeTable.mounts */
+	uint32_t parent, first_child, next_sibling;
+} TNode;
+
+typedef struct {
+	TNode *nodes;
+	uint32_t n;
+	uint32_t *mounts;               /* pool offsets */
+	uint32_t nmounts;
+	char *pool;
+	size_t pool_len, pool_cap;
+	struct { const char *s; uint32_t off; } seen[64];  /* interned strings already pooled */
+} NodeTable;
+
+static uint32_t pool_add(NodeTable *t, const char *s) {
+	size_t len = strlen(s);
+	if (!len) return 0;
+	if (t->pool_len + len + 1 > t->pool_cap) {
+		size_t cap = t->pool_cap ? t->pool_cap * 2 : 65536;
+		while (cap < t->pool_len + len + 1) cap *= 2;
+		char *p = mem_realloc(t->pool, cap);
+		if (!p) return 0;
+		t->pool = p;
+		t->pool_cap = cap;
+	}
+	if (t->pool_len + len + 1 > UINT32_MAX) return 0;
+	uint32_t off = (uint32_t)t->pool_len;
+	memcpy(t->pool + off, s, len + 1);
+	t->pool_len += len + 1;
+	return off;
+}
+
+/* type and fstype are arena-interned: pool each distinct pointer once */
+static uint32_t pool_add_interned(NodeTable *t, const char *s) {
+	size_t h = ((uintptr_t)s >> 3) & 63;
+	if (t->seen[h].s != s) {
+		t->seen[h].s = s;
+		t->seen[h].off = pool_add(t, s);
+	}
+	return t->seen[h].off;
+}
+
+/* Append n and its subtree in pre-order; returns n's index */
+static uint32_t table_add(NodeTable *t, const Node *n, uint32_t parent) {
+	uint32_t i = t->n++;
+	TNode *e = &t->nodes[i];
+	e->size = n->size;
+	e->name = pool_add(t, n->name);
+	e->type = pool_add_interned(t, n->type);
+	e->mountpoint = pool_add(t, n->mountpoint);
+	e->fstype = pool_add_interned(t, n->fstype);
+	e->label = pool_add(t, n->label);
+	e->uuid = pool_add(t, n->uuid);
+	e->role = pool_add_interned(t, n->role);
+	e->encrypted = pool_add_interned(t, n->encrypted);
+	e->fsused = n->fsused;
+	e->mounts = t->nmounts;
+	e->nmounts = (uint32_t)n->nmounts;
+	for (int m = 0; m < n->nmounts; m++) {
+		uint32_t off = pool_add(t, n->mounts[m]);
+		t->mounts[t->nmounts++] = off;
+	}
+	e->parent = parent;
+	e->first_child = e->next_sibling = NT_NONE;
+	uint32_t prev = NT_NONE;
+	for (int c = 0; c < n->nchildren; c++) {
+		uint32_t ci = table_add(t, n->children[c], i);
+		if (prev == NT_NONE) t->nodes[i].first_child = ci;
+		else t->nodes[prev].next_sibling = ci;
+		prev = ci;
+	}
+	return i;
+}
+
+/* Build the table from the sorted roots; the NodeArray can be freed afterwards */
+static int node_table_freeze(NodeTable *t, const NodeArray *flat) {
+	*t = (NodeTable){ 0 };
+	size_t nmounts = 0;
+	for (int i = 0; i < flat->n; i++)
+		nmounts += (size_t)flat->arr[i]->nmounts;
+	t->nodes = mem_malloc(((size_t)flat->n + 1) * sizeof(TNode));
+	t->mounts = mem_malloc((nmounts + 1) * sizeof(uint32_t));
+	t->pool_cap = 65536;
+	t->pool = mem_malloc(t->pool_cap);
+	if (!t->nodes || !t->mounts || !t->pool) return -1;
+	t->pool[0] = '\0';              /* offset 0: the empty string */
+	t->pool_len = 1;
+	uint32_t prev = NT_NONE;
+	for (int i = 0; i < flat->nroots; i++) {
+		uint32_t ri = table_add(t, flat->roots[i], NT_NONE);
+		if (prev != NT_NONE) t->nodes[prev].next_sibling = ri;
+		prev = ri;
+	}
+	return 0;
+}
+
+static void node_table_free(NodeTable *t) {
+	mem_free(t->nodes);
+	mem_free(t->mounts);
+	mem_free(t->pool);
+	*t = (NodeTable){ 0 };
+}
+
+#define NT_STR(t, off) ((t)->pool + (off))
+
+/* Column names we support */
+enum Col { COL_NAME, COL_SIZE, COL_TYPE, COL_MOUNTPOINT, COL_FSTYPE, COL_LABEL, COL_UUID, COL_MOUNTPOINTS,
+	COL_ROLE, COL_ENCRYPTED, COL_FSUSED, COL_MAX };
+static const char *col_names[] = { "NAME", "SIZE", "TYPE", "MOUNTPOINT", "FSTYPE", "LABEL", "UUID", "MOUNTPOINTS",
+	"ROLE", "ENCRYPTED", "FSUSED" };
+
+/* Sizes are right-aligned in tables */
+static bool col_right(int col) {
+	return col == COL_SIZE || col == COL_FSUSED;
+}
+
+/* *cols is malloc'd, sized by the number of comma-separated names */
+static int parse_columns(const char *ostr, int **cols, int *ncols) {
+	*ncols = 0;
+	size_t max = 1;
+	for (const char *p = ostr; *p; p++)
+		max += *p == ',';
+	char *s = mem_strdup(ostr);
+	int *c = mem_malloc(max * sizeof(int));
+	if (!s || !c) { mem_free(s); mem_free(c); return -1; }
+	mem_free(*cols);
+	*cols = c;
+	for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+		while (*tok == ' ') tok++;
+		for (int i = 0; i < COL_MAX; i++)
+			if (strcasecmp(tok, col_names[i]) == 0) {
+				c[(*ncols)++] = i;
+				break;
+			}
+	}
+	mem_free(s);
+	return 0;
+}
+
+static int parse_output_option(const char *ostr, int **cols, int *ncols) {
+	if (!ostr || !ostr[0]) {
+		const char *def = DEFAULT_COLS;
+		return parse_columns(def, cols, ncols);
+	}
+	/* At least one known column */
+	return parse_columns(ostr, cols, ncols) == 0 && *ncols > 0 ? 0 : -1;
+}
+
+/*
+ * Column registry: the K_* fields each column needs and the sources that can
+ * supply them. Sources are numbered cheapest first, and the planner visits
+ * them in that order: each one runs only if a requested column needs what it
+ * gives and some device still lacks it (Node.known). Sources that start
+ * diskutil are only used with -f, except apfs for the columns nothing else
+ * supplies. --explain prints the decisions.
+ */
+enum Src { SRC_LIST, SRC_MOUNTS, SRC_CACHE, SRC_APFS, SRC_INFO_ALL, SRC_SPAWN, SRC_MAX };
+#define SRC(s) (1u << SRC_##s)
+#define SRC_INFO_ANY (SRC(CACHE) | SRC(APFS) | SRC(INFO_ALL) | SRC(SPAWN))
+
+static const struct { const char *name, *cost; } src_info[SRC_MAX] = {
+	[SRC_LIST] = { "list", "diskutil list or sysfs, once" },
+	[SRC_MOUNTS] = { "mounts", "mount table, once" },
+	[SRC_CACHE] = { "udev", "udev database, 1 read per device" },
+	[SRC_APFS] = { "apfs", "diskutil apfs list, once" },
+	[SRC_INFO_ALL] = { "info-all", "diskutil info -all, once" },
+	[SRC_SPAWN] = { "info", "diskutil info, 1 per device" },
+};
+
+static const struct { unsigned need, from; } col_plan[COL_MAX] = {
+	[COL_NAME] = { 0, SRC(LIST) },
+	[COL_SIZE] = { 0, SRC(LIST) },
+	[COL_TYPE] = { 0, SRC(LIST) },
+	[COL_MOUNTPOINT] = { K_MOUNT, SRC(LIST) | SRC(MOUNTS) },
+	[COL_FSTYPE] = { K_FSTYPE, SRC(LIST) | SRC(MOUNTS) | SRC_INFO_ANY },
+	[COL_LABEL] = { K_LABEL, SRC(LIST) | SRC_INFO_ANY },
+	[COL_UUID] = { K_UUID, SRC(LIST) | SRC_INFO_ANY },
+	[COL_MOUNTPOINTS] = { K_MOUNT, SRC(MOUNTS) },
+	[COL_ROLE] = { K_APFS, SRC(APFS) },
+	[COL_ENCRYPTED] = { K_APFS, SRC(APFS) },
+	[COL_FSUSED] = { K_APFS, SRC(APFS) },
+};
+
+typedef struct {
+	bool explain;
+	unsigned need;        /* K_* fields of the requested columns */
+	unsigned avail;       /* SRC() bits this run may use */
+	unsigned want[SRC_MAX];   /* needed fields each source can supply */
+	bool run[SRC_MAX];
+	const char *why[SRC_MAX];
+	int left[SRC_MAX];    /* devices still lacking a needed field after the step */
+} Plan;
+
+/* A recording keeps the mount table, and with -f every info source, whatever the columns */
+static void plan_init(Plan *p, const int *cols, int ncols, const Source *src, bool opt_f, bool info_all, bool record) {
+	*p = (Plan){ .explain = p->explain, .avail = SRC(LIST) | SRC(MOUNTS), .run[SRC_LIST] = true };
+	for (int c = 0; c < ncols; c++) {
+		p->need |= col_plan[cols[c]].need;
+		for (int s = 0; s < SRC_MAX; s++)
+			if (col_plan[cols[c]].from & (1u << s)) p->want[s] |= col_plan[cols[c]].need;
+	}
+	if (record) {
+		p->need |= K_MOUNT | (opt_f ? K_INFO : 0);
+		p->want[SRC_MOUNTS] |= K_MOUNT;
+		if (opt_f) {
+			p->want[SRC_APFS] |= K_INFO | K_APFS;
+			p->want[SRC_INFO_ALL] |= K_INFO;
+			p->want[SRC_SPAWN] |= K_INFO;
+		}
+	}
+	if (src->scan) p->avail |= SRC(CACHE);
+	else p->why[SRC_CACHE] = "not available: diskutil source";
+	if (!src->bulk) p->why[SRC_APFS] = p->why[SRC_INFO_ALL] = "not available: sysfs source";
+	else {
+		if (opt_f || (p->need & K_APFS)) p->avail |= SRC(APFS);
+		else p->why[SRC_APFS] = "not used without -f";
+		if (opt_f && info_all) p->avail |= SRC(INFO_ALL);
+		else p->why[SRC_INFO_ALL] = "not used without -f --info=all";
+	}
+	if (src->scan) p->why[SRC_SPAWN] = "not available: sysfs source";
+	else if (opt_f) p->avail |= SRC(SPAWN);
+	else p->why[SRC_SPAWN] = "not used without -f";
+}
+
+/* Devices lacking one of fields; with apfs_only, among APFS devices */
+static int plan_missing(const NodeArray *flat, unsigned fields, bool apfs_only) {
+	int n = 0;
+	fields &= ~(unsigned)K_MOUNT;
+	for (int i = 0; fields && i < flat->n; i++)
+		if ((fields & ~flat->arr[i]->known) && (!apfs_only || strcmp(flat->arr[i]->fstype, "apfs") == 0))
+			n++;
+	return n;
+}
+
+/* Decide whether source s runs now */
+static bool plan_step(Plan *p, const NodeArray *flat, int s) {
+	unsigned want = p->want[s];
+	if (!(p->avail & (1u << s))) return false;
+	if (!want) p->why[s] = "skipped: no requested column needs it";
+	else if ((want & (K_MOUNT | K_APFS)) || plan_missing(flat, want, s == SRC_APFS)) p->run[s] = true;
+	else p->why[s] = "skipped: already known for every device";
+	return p->run[s];
+}
+
+static void plan_done(Plan *p, const NodeArray *flat, int s) {
+	if (p->explain) p->left[s] = plan_missing(flat, p->need, false);
+}
+
+static void plan_explain(const Plan *p, const int *cols, int ncols) {
+	if (!p->explain) return;
+	fprintf(stderr, "mlsblk: plan\n  %-12s %s\n", "column", "sources, cheapest first");
+	for (int c = 0; c < ncols; c++) {
+		fprintf(stderr, "  %-12s", col_names[cols[c]]);
+		const char *sep = " ";
+		for (int s = 0; s < SRC_MAX; s++)
+			if (col_plan[cols[c]].from & p->avail & (1u << s)) {
+				fprintf(stderr, "%s%s", sep, src_info[s].name);
+				sep = ", ";
+			}
+		fprintf(stderr, "%s\n", *sep == ' ' ? " (none available)" : "");
+	}
+	fprintf(stderr, "  %-9s %-34s %5s  %s\n", "source", "cost", "left", "decision");
+	for (int s = 0; s < SRC_MAX; s++) {
+		if (p->run[s])
+			fprintf(stderr, "  %-9s %-34s %5d  run\n", src_info[s].name, src_info[s].cost, p->left[s]);
+		else
+			fprintf(stderr, "  %-9s %-34s %5s  %s\n", src_info[s].name, src_info[s].cost, "-",
+				p->why[s] ? p->why[s] : "skipped");
+	}
+}
+
+/*
+ * Output writer: everything goes into one buffer, flushed to the fd with
+ * write() in OUT_BUF-sized chunks. After a write error the rest is dropped
+ * and out_close() reports it. With fd -1 the buffer grows in memory instead.
+ */
+#define OUT_BUF (1 << 20)
+
+typedef struct {
+	char *buf;
+	size_t len, cap;
+	int fd;
+	int err;              /* errno of the first failed write */
+} Out;
+
+static void out_flush(Out *o) {
+	if (o->fd < 0) return;    /* in memory: nothing to write */
+	size_t off = 0;
+	while (off < o->len && !o->err) {
+		ssize_t w = write(o->fd, o->buf + off, o->len - off);
+		if (w < 0 && errno == EINTR) continue;
+		if (w <= 0) o->err = w < 0 ? errno : EIO;
+		else off += (size_t)w;
+	}
+	o->len = 0;
+}
+
+static int out_open(Out *o, int fd) {
+	*o = (Out){ .fd = fd, .buf = mem_malloc(OUT_BUF), .cap = OUT_BUF };
+	return o->buf ? 0 : -1;
+}
+
+static int out_close(Out *o) {
+	out_flush(o);
+	mem_free(o->buf);
+	o->buf = NULL;
+	errno = o->err;
+	return o->err ? -1 : 0;
+}
+
+/* Make room for n more bytes: flush to the fd, or grow an in-memory Out */
+static bool out_room(Out *o, size_t n) {
+	if (o->fd >= 0) {
+		out_flush(o);
+		return n <= o->cap;
+	}
+	if (o->err) return false;
+	size_t cap = o->cap;
+	while (cap < o->len + n) cap *= 2;
+	char *b = mem_realloc(o->buf, cap);
+	if (!b) { o->err = ENOMEM; return false; }
+	o->buf = b;
+	o->cap = cap;
+	return true;
+}
+
+static void out_mem(Out *o, const char *s, size_t n) {
+	if (o->len + n > o->cap && !out_room(o, n)) {
+		/* larger than the buffer: straight through */
+		while (n && o->fd >= 0 && !o->err) {
+			size_t k = n < o->cap ? n : o->cap;
+			memcpy(o->buf, s, k);
+			o->len = k;
+			out_flush(o);
+			s += k;
+			n -= k;
+		}
+		return;
+	}
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
+}
+
+static void out_str(Out *o, const char *s) {
+	out_mem(o, s, strlen(s));
+}
+
+static void out_ch(Out *o, char c) {
+	if (o->len == o->cap && !out_room(o, 1)) return;
+	o->buf[o->len++] = c;
+}
+
+static void out_u64(Out *o, uint64_t v) {
+	char tmp[20];
+	int n = sizeof(tmp);
+	do tmp[--n] = (char)('0' + v % 10); while (v /= 10);
+	out_mem(o, tmp + n, sizeof(tmp) - (size_t)n);
+}
+
+static void out_size(Out *o, uint64_t bytes) {
+	char tmp[32];
+	out_mem(o, tmp, (size_t)fmt_size(bytes, tmp));
+}
+
+static void out_pad(Out *o, int n) {
+	while (n-- > 0) out_ch(o, ' ');
+}
+
+/* MOUNTPOINTS: every mount, comma-separated; the plist mountpoint if the mount table had none */
+static void print_mountpoints(Out *o, const NodeTable *t, const TNode *n) {
+	if (!n->nmounts) { out_str(o, NT_STR(t, n->mountpoint)); return; }
+	for (uint32_t i = 0; i < n->nmounts; i++) {
+		if (i) out_ch(o, ',');
+		out_str(o, NT_STR(t, t->mounts[n->mounts + i]));
+	}
+}
+
+static void print_cell(Out *o, const NodeTable *t, const TNode *n, int col) {
+	switch (col) {
+	case COL_NAME: out_str(o, NT_STR(t, n->name)); break;
+	case COL_SIZE: out_size(o, n->size); break;
+	case COL_TYPE: out_str(o, NT_STR(t, n->type)); break;
+	case COL_MOUNTPOINT: out_str(o, NT_STR(t, n->mountpoint)); break;
+	case COL_FSTYPE: out_str(o, NT_STR(t, n->fstype)); break;
+	case COL_LABEL: out_str(o, NT_STR(t, n->label)); break;
+	case COL_UUID: out_str(o, NT_STR(t, n->uuid)); break;
+	case COL_MOUNTPOINTS: print_mountpoints(o, t, n); break;
+	case COL_ROLE: out_str(o, NT_STR(t, n->role)); break;
+	case COL_ENCRYPTED: out_str(o, NT_STR(t, n->encrypted)); break;
+	case COL_FSUSED: if (n->fsused) out_size(o, n->fsused); break;
+	default: break;
+	}
+}
+
+/*
+ * Terminal width of a UTF-8 string: the byte count when it is all ASCII
+ * (checked 8 bytes at a time), else one column per code point, two for East
+ * Asian wide ranges and none for combining marks.
+ */
+static uint32_t display_width(const char *s, size_t len) {
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		if (w & 0x8080808080808080ull) break;
+	}
+	while (i < len && !(s[i] & 0x80)) i++;
+	if (i == len) return (uint32_t)len;
+	uint32_t width = (uint32_t)i;
+	while (i < len) {
+		unsigned char c = (unsigned char)s[i];
+		uint32_t cp = c;
+		int n = c < 0x80 ? 1 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+		if (n > 1) {
+			cp = c & (0x3f >> (n - 1));
+			for (int k = 1; k < n && i + k < len; k++)
+				cp = (cp << 6) | ((unsigned char)s[i + k] & 0x3f);
+		}
+		i += (size_t)n;
+		if (cp >= 0x300 && cp <= 0x36f) continue;
+		bool wide = (cp >= 0x1100 && cp <= 0x115f) || (cp >= 0x2e80 && cp <= 0xa4cf) ||
+			(cp >= 0xac00 && cp <= 0xd7a3) || (cp >= 0xf900 && cp <= 0xfaff) ||
+			(cp >= 0xfe30 && cp <= 0xfe4f) || (cp >= 0xff00 && cp <= 0xff60) ||
+			(cp >= 0xffe0 && cp <= 0xffe6) || (cp >= 0x1f300 && cp <= 0x1f64f) ||
+			(cp >= 0x1f900 && cp <= 0x1f9ff) || (cp >= 0x20000 && cp <= 0x3fffd);
+		width += wide ? 2 : 1;
+	}
+	return width;
+}
 
-	/* Free tree via roots only (nodes are shared with flat.arr) */
-	for (int i = 0; i < nroots; i++)
-		node_free(roots[i]);
-	free(flat.arr);
+/* Tree prefix; grows with depth, each level truncates it back on return */
+typedef struct {
+	char *s;
+	size_t len, cap;
+} Prefix;
+static int prefix_push(Prefix *p, const char *s) {
+	size_t n = strlen(s);
+	if (p->len + n + 1 > p->cap) {
+		size_t cap = p->cap ? p->cap * 2 : 256;
+		while (cap < p->len + n + 1) cap *= 2;
+		char *ns = mem_realloc(p->s, cap);
+		if (!ns) return -1;
+		p->s = ns;
+		p->cap = cap;
+	}
+	memcpy(p->s + p->len, s, n + 1);
+	p->len += n;
 	return 0;
 }
+
+/*
+ * Aligned table: cells are rendered once, back to back into text, with
+ * their end offsets and display widths; table_emit() then pads each to its
+ * column's widest cell. The header is row 0.
+ */
+typedef struct {
+	Out text;
+	size_t *end;          /* end of each cell in text.buf */
+	uint32_t *width;      /* display width of each cell */
+	size_t n, cap;
+	size_t start;         /* where the open cell began */
+	int ncols;
+	uint32_t *colw;       /* widest cell per column */
+} Table;
+
+static int table_init(Table *tb, int ncols) {
+	*tb = (Table){ .ncols = ncols, .colw = mem_calloc((size_t)ncols + 1, sizeof(uint32_t)) };
+	return tb->colw && out_open(&tb->text, -1) == 0 ? 0 : -1;
+}
+
+static void table_free(Table *tb) {
+	out_close(&tb->text);
+	mem_free(tb->end);
+	mem_free(tb->width);
+	mem_free(tb->colw);
+}
+
+/* Close the cell rendered into tb->text since the previous one */
+static void table_cell(Table *tb) {
+	if (tb->n >= tb->cap) {
+		size_t cap = tb->cap ? tb->cap * 2 : 4096;
+		size_t *e = mem_realloc(tb->end, cap * sizeof(size_t));
+		if (e) tb->end = e;
+		uint32_t *w = mem_realloc(tb->width, cap * sizeof(uint32_t));
+		if (w) tb->width = w;
+		if (!e || !w) { tb->text.err = ENOMEM; return; }
+		tb->cap = cap;
+	}
+	uint32_t w = display_width(tb->text.buf + tb->start, tb->text.len - tb->start);
+	int col = (int)(tb->n % (size_t)tb->ncols);
+	if (w > tb->colw[col]) tb->colw[col] = w;
+	tb->width[tb->n] = w;
+	tb->end[tb->n++] = tb->start = tb->text.len;
+}
+
+/* Second pass: one space between columns, sizes right-aligned, no trailing pad */
+static void table_emit(Out *o, const Table *tb, const int *cols) {
+	if (tb->text.err) return;
+	size_t start = 0;
+	for (size_t i = 0; i < tb->n; i++) {
+		int col = (int)(i % (size_t)tb->ncols);
+		bool lastcol = col == tb->ncols - 1;
+		int pad = (int)(tb->colw[col] - tb->width[i]);
+		if (col) out_ch(o, ' ');
+		if (col_right(cols[col])) out_pad(o, pad);
+		out_mem(o, tb->text.buf + start, tb->end[i] - start);
+		if (!col_right(cols[col]) && !lastcol) out_pad(o, pad);
+		if (lastcol) out_ch(o, '\n');
+		start = tb->end[i];
+	}
+}
+
+static void table_header(Table *tb, int *cols, int ncols) {
+	for (int c = 0; c < ncols; c++) {
+		out_str(&tb->text, col_names[cols[c]]);
+		table_cell(tb);
+	}
+}
+
+/* One row; the tree, if any, is drawn in front of the NAME cell */
+static void table_row(Table *tb, const NodeTable *t, const TNode *n, int *cols, int ncols, const Prefix *p, const char *branch) {
+	for (int c = 0; c < ncols; c++) {
+		if (cols[c] == COL_NAME && branch) {
+			out_mem(&tb->text, p->s, p->len);
+			out_str(&tb->text, branch);
+		}
+		print_cell(&tb->text, t, n, cols[c]);
+		table_cell(tb);
+	}
+}
+
+/* Children of i are drawn after p; their subtrees after p + this level's rail */
+static void tree_rows(Table *tb, const NodeTable *t, uint32_t i, int *cols, int ncols, Prefix *p) {
+	size_t len = p->len;
+	for (uint32_t c = t->nodes[i].first_child; c != NT_NONE; c = t->nodes[c].next_sibling) {
+		const TNode *ch = &t->nodes[c];
+		bool is_last = ch->next_sibling == NT_NONE;
+		p->len = len;
+		table_row(tb, t, ch, cols, ncols, p, is_last ? "└── " : "├── ");
+		if (ch->first_child != NT_NONE && prefix_push(p, is_last ? "   " : "│  ") == 0)
+			tree_rows(tb, t, c, cols, ncols, p);
+	}
+	p->len = len;
+}
+
+static int print_trees(Out *o, const NodeTable *t, int *cols, int ncols) {
+	Table tb;
+	Prefix p = { 0 };
+	if (table_init(&tb, ncols) != 0 || prefix_push(&p, "  ") != 0) {
+		table_free(&tb);
+		mem_free(p.s);
+		return -1;
+	}
+	uint64_t tl = span_begin();
+	table_header(&tb, cols, ncols);
+	for (uint32_t i = t->n ? 0 : NT_NONE; i != NT_NONE; i = t->nodes[i].next_sibling) {
+		const TNode *r = &t->nodes[i];
+		table_row(&tb, t, r, cols, ncols, &p, NULL);
+		tree_rows(&tb, t, i, cols, ncols, &p);
+	}
+	trace_span("layout", tl);
+	uint64_t te = span_begin();
+	table_emit(o, &tb, cols);
+	trace_span("emit", te);
+	int rc = tb.text.err ? -1 : 0;
+	table_free(&tb);
+	mem_free(p.s);
+	return rc;
+}
+
+/* First byte JSON cannot take verbatim: '"', '\\', control, or non-ASCII (validated separately) */
+static const char *scan_json(const char *p, const char *end) {
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"'), bslash = _mm_set1_epi8('\\'), space = _mm_set1_epi8(' ');
+	for (; end - p >= 16; p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		/* signed compare: below ' ' also catches bytes >= 0x80 */
+		__m128i m = _mm_or_si128(_mm_cmplt_epi8(v, space),
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)));
+		unsigned bits = (unsigned)_mm_movemask_epi8(m);
+		if (bits) return p + __builtin_ctz(bits);
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t quote = vdupq_n_u8('"'), bslash = vdupq_n_u8('\\');
+	const uint8x16_t space = vdupq_n_u8(' '), high = vdupq_n_u8(0x80);
+	for (; end - p >= 16; p += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *)p);
+		uint8x16_t m = vorrq_u8(vorrq_u8(vcltq_u8(v, space), vcgeq_u8(v, high)),
+			vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, bslash)));
+		uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		if (bits) return p + (__builtin_ctzll(bits) >> 2);
+	}
+#endif
+	for (; p < end; p++) {
+		unsigned char c = (unsigned char)*p;
+		if (c < ' ' || c >= 0x80 || c == '"' || c == '\\') return p;
+	}
+	return end;
+}
+
+/* Length of the well-formed UTF-8 sequence at p (RFC 3629), 0 if malformed */
+static int utf8_len(const unsigned char *p, const unsigned char *end) {
+	int n = p[0] >= 0xf0 ? 4 : p[0] >= 0xe0 ? 3 : p[0] >= 0xc2 ? 2 : 0;
+	if (!n || p[0] > 0xf4 || end - p < n) return 0;
+	for (int k = 1; k < n; k++)
+		if ((p[k] & 0xc0) != 0x80) return 0;
+	if ((p[0] == 0xe0 && p[1] < 0xa0) || (p[0] == 0xed && p[1] >= 0xa0) ||
+	    (p[0] == 0xf0 && p[1] < 0x90) || (p[0] == 0xf4 && p[1] >= 0x90))
+		return 0;   /* overlong, surrogate or above U+10FFFF */
+	return n;
+}
+
+/* s as a JSON string: verbatim runs are copied in bulk, malformed UTF-8 becomes U+FFFD */
+static void out_json_str(Out *o, const char *s) {
+	static const char hex[] = "0123456789abcdef";
+	const char *end = s + strlen(s);
+	out_ch(o, '"');
+	while (s < end) {
+		const char *q = scan_json(s, end);
+		out_mem(o, s, (size_t)(q - s));
+		if (q == end) break;
+		unsigned char c = (unsigned char)*q;
+		s = q + 1;
+		if (c >= 0x80) {
+			int n = utf8_len((const unsigned char *)q, (const unsigned char *)end);
+			if (n) { out_mem(o, q, (size_t)n); s = q + n; }
+			else out_str(o, "\\ufffd");
+			continue;
+		}
+		out_ch(o, '\\');
+		switch (c) {
+		case '"': case '\\': out_ch(o, (char)c); break;
+		case '\b': out_ch(o, 'b'); break;
+		case '\f': out_ch(o, 'f'); break;
+		case '\n': out_ch(o, 'n'); break;
+		case '\r': out_ch(o, 'r'); break;
+		case '\t': out_ch(o, 't'); break;
+		default:
+			out_str(o, "u00");
+			out_ch(o, hex[c >> 4]);
+			out_ch(o, hex[c & 15]);
+		}
+	}
+	out_ch(o, '"');
+}
+
+static const char *col_keys[] = { "name", "size", "type", "mountpoint", "fstype", "label", "uuid", "mountpoints",
+	"role", "encrypted", "fsused" };
+
+static void json_value(Out *o, const NodeTable *t, const TNode *n, int col) {
+	switch (col) {
+	case COL_NAME: out_json_str(o, NT_STR(t, n->name)); break;
+	case COL_SIZE: out_u64(o, n->size); break;
+	case COL_TYPE: out_json_str(o, NT_STR(t, n->type)); break;
+	case COL_MOUNTPOINT: out_json_str(o, NT_STR(t, n->mountpoint)); break;
+	case COL_FSTYPE: out_json_str(o, NT_STR(t, n->fstype)); break;
+	case COL_LABEL: out_json_str(o, NT_STR(t, n->label)); break;
+	case COL_UUID: out_json_str(o, NT_STR(t, n->uuid)); break;
+	case COL_MOUNTPOINTS:
+		out_ch(o, '[');
+		if (!n->nmounts && NT_STR(t, n->mountpoint)[0])
+			out_json_str(o, NT_STR(t, n->mountpoint));
+		for (uint32_t m = 0; m < n->nmounts; m++) {
+			if (m) out_ch(o, ',');
+			out_json_str(o, NT_STR(t, t->mounts[n->mounts + m]));
+		}
+		out_ch(o, ']');
+		break;
+	case COL_ROLE: out_json_str(o, NT_STR(t, n->role)); break;
+	case COL_ENCRYPTED: {
+		const char *e = NT_STR(t, n->encrypted);
+		out_str(o, e[0] == 'y' ? "true" : e[0] == 'n' ? "false" : "null");
+		break;
+	}
+	case COL_FSUSED:
+		if (n->fsused) out_u64(o, n->fsused);
+		else out_str(o, "null");
+		break;
+	default: out_str(o, "null"); break;
+	}
+}
+
+/* One object per node with the selected columns, written as it is walked */
+static void emit_json(Out *o, const NodeTable *t, uint32_t i, int *cols, int ncols, int depth, bool first) {
+	const TNode *n = &t->nodes[i];
+	out_str(o, first ? "\n" : ",\n");
+	out_pad(o, depth * 2);
+	out_ch(o, '{');
+	for (int c = 0; c < ncols; c++) {
+		if (c) out_ch(o, ',');
+		out_ch(o, '"');
+		out_str(o, col_keys[cols[c]]);
+		out_str(o, "\":");
+		json_value(o, t, n, cols[c]);
+	}
+	if (n->first_child != NT_NONE) {
+		out_str(o, ",\"children\":[");
+		for (uint32_t c = n->first_child; c != NT_NONE; c = t->nodes[c].next_sibling)
+			emit_json(o, t, c, cols, ncols, depth + 1, c == n->first_child);
+		out_ch(o, '\n');
+		out_pad(o, depth * 2);
+		out_ch(o, ']');
+	}
+	out_ch(o, '}');
+}
+
+static void print_json(Out *o, const NodeTable *t, int *cols, int ncols) {
+	out_str(o, "{\"blockdevices\":[");
+	for (uint32_t i = t->n ? 0 : NT_NONE; i != NT_NONE; i = t->nodes[i].next_sibling)
+		emit_json(o, t, i, cols, ncols, 1, i == 0);
+	out_str(o, "\n]}\n");
+}
+
+/* Row formats; FMT_LIST is the aligned table */
+enum Fmt { FMT_LIST, FMT_RAW, FMT_PAIRS, FMT_CSV, FMT_NDJSON };
+
+/*
+ * lsblk -r / -P escaping: unsafe bytes become \xHH. Raw escapes blanks so
+ * fields split on spaces; pairs keeps spaces but escapes what a shell or
+ * the quoting would interpret. Non-ASCII (UTF-8) is kept.
+ */
+static void out_hex_escaped(Out *o, const char *s, size_t len, int fmt) {
+	static const char hex[] = "0123456789abcdef", HEX[] = "0123456789ABCDEF";
+	const char *digits = fmt == FMT_PAIRS ? HEX : hex;
+	size_t run = 0;
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)s[i];
+		bool esc = c < 0x20 || c == 0x7f || c == '\\' ||
+			(fmt == FMT_RAW ? c == ' ' : c == '"' || c == '`' || c == '$');
+		if (!esc) continue;
+		out_mem(o, s + run, i - run);
+		out_str(o, "\\x");
+		out_ch(o, digits[c >> 4]);
+		out_ch(o, digits[c & 15]);
+		run = i + 1;
+	}
+	out_mem(o, s + run, len - run);
+}
+
+/* RFC 4180: quote a field holding a comma, quote or line break; double the quotes */
+static void out_csv(Out *o, const char *s, size_t len) {
+	if (!memchr(s, ',', len) && !memchr(s, '"', len) && !memchr(s, '\n', len) && !memchr(s, '\r', len)) {
+		out_mem(o, s, len);
+		return;
+	}
+	out_ch(o, '"');
+	for (const char *q; (q = memchr(s, '"', len)); len -= (size_t)(q + 1 - s), s = q + 1) {
+		out_mem(o, s, (size_t)(q + 1 - s));
+		out_ch(o, '"');
+	}
+	out_mem(o, s, len);
+	out_ch(o, '"');
+}
+
+/* One cell in fmt; the value is rendered by print_cell() into scratch first */
+static void row_cell(Out *o, Out *scratch, const NodeTable *t, const TNode *n, int col, int fmt) {
+	if (fmt == FMT_NDJSON) {
+		json_value(o, t, n, col);
+		return;
+	}
+	scratch->len = 0;
+	print_cell(scratch, t, n, col);
+	if (fmt == FMT_CSV) out_csv(o, scratch->buf, scratch->len);
+	else out_hex_escaped(o, scratch->buf, scratch->len, fmt);
+}
+
+/*
+ * Single pass over the pre-order table for every list format. FMT_LIST
+ * goes through the aligned Table; the others are written straight out, one
+ * line per node, NDJSON naming each node's parent instead of nesting.
+ */
+static int print_rows(Out *o, const NodeTable *t, int *cols, int ncols, int fmt) {
+	if (fmt == FMT_LIST) {
+		Table tb;
+		if (table_init(&tb, ncols) != 0) {
+			table_free(&tb);
+			return -1;
+		}
+		uint64_t tl = span_begin();
+		table_header(&tb, cols, ncols);
+		for (uint32_t i = 0; i < t->n; i++)
+			table_row(&tb, t, &t->nodes[i], cols, ncols, NULL, NULL);
+		trace_span("layout", tl);
+		uint64_t te = span_begin();
+		table_emit(o, &tb, cols);
+		trace_span("emit", te);
+		int rc = tb.text.err ? -1 : 0;
+		table_free(&tb);
+		return rc;
+	}
+	Out scratch;
+	if (out_open(&scratch, -1) != 0) return -1;
+	if (fmt == FMT_RAW || fmt == FMT_CSV) {
+		for (int c = 0; c < ncols; c++) {
+			if (c) out_ch(o, fmt == FMT_CSV ? ',' : ' ');
+			out_str(o, col_names[cols[c]]);
+		}
+		out_ch(o, '\n');
+	}
+	for (uint32_t i = 0; i < t->n; i++) {
+		const TNode *n = &t->nodes[i];
+		if (fmt == FMT_NDJSON) {
+			out_str(o, "{\"parent\":");
+			if (n->parent == NT_NONE) out_str(o, "null");
+			else out_json_str(o, NT_STR(t, t->nodes[n->parent].name));
+		}
+		for (int c = 0; c < ncols; c++) {
+			switch (fmt) {
+			case FMT_RAW: if (c) out_ch(o, ' '); break;
+			case FMT_CSV: if (c) out_ch(o, ','); break;
+			case FMT_PAIRS:
+				if (c) out_ch(o, ' ');
+				out_str(o, col_names[cols[c]]);
+				out_str(o, "=\"");
+				break;
+			case FMT_NDJSON:
+				out_str(o, ",\"");
+				out_str(o, col_keys[cols[c]]);
+				out_str(o, "\":");
+				break;
+			}
+			row_cell(o, &scratch, t, n, cols[c], fmt);
+			if (fmt == FMT_PAIRS) out_ch(o, '"');
+		}
+		out_str(o, fmt == FMT_NDJSON ? "}\n" : "\n");
+	}
+	int rc = scratch.err ? -1 : 0;
+	out_close(&scratch);
+	return rc;
+}
+
+int main(int argc, char **argv) {
+	bool opt_f = false;
+	bool opt_J = false;
+	bool opt_list = false;
+	int opt_fmt = -1;     /* a list format other than the aligned table */
+	char *opt_o = NULL;
+	int opt_jobs = 0;
+	bool opt_info_all = false;
+	Plan plan = { 0 };
+	const char *opt_record = NULL;
+	const char *opt_replay = NULL;
+	const char *opt_timing = getenv("MLSBLK_TRACE");
+	bool timing_env = true;    /* opt_timing came from MLSBLK_TRACE, not --timing */
+
+	enum { OPT_JOBS = 256, OPT_RECORD, OPT_REPLAY, OPT_CSV, OPT_NDJSON, OPT_TIMING, OPT_TRACE_FILE, OPT_PERF, OPT_MEM_STATS, OPT_INFO, OPT_EXPLAIN };
+	static const struct option longopts[] = {
+		{ "csv", no_argument, NULL, OPT_CSV },
+		{ "ndjson", no_argument, NULL, OPT_NDJSON },
+		{ "jobs", required_argument, NULL, OPT_JOBS },
+		{ "info", required_argument, NULL, OPT_INFO },
+		{ "record", required_argument, NULL, OPT_RECORD },
+		{ "replay", required_argument, NULL, OPT_REPLAY },
+		{ "timing", optional_argument, NULL, OPT_TIMING },
+		{ "trace-file", required_argument, NULL, OPT_TRACE_FILE },
+		{ "perf-counters", no_argument, NULL, OPT_PERF },
+		{ "mem-stats", no_argument, NULL, OPT_MEM_STATS },
+		{ "explain", no_argument, NULL, OPT_EXPLAIN },
+		{ NULL, 0, NULL, 0 }
+	};
+	int ch;
+	while ((ch = getopt_long(argc, argv, "fo:JlrP", longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'f': opt_f = true; break;
+		case 'o': opt_o = optarg; break;
+		case 'J': opt_J = true; break;
+		case 'l': opt_list = true; break;
+		case 'r': opt_fmt = FMT_RAW; break;
+		case 'P': opt_fmt = FMT_PAIRS; break;
+		case OPT_CSV: opt_fmt = FMT_CSV; break;
+		case OPT_NDJSON: opt_fmt = FMT_NDJSON; break;
+		case OPT_JOBS: {
+			char *end;
+			long v = strtol(optarg, &end, 10);
+			if (*end || v < 1 || v > MAX_JOBS) {
+				fprintf(stderr, "mlsblk: --jobs must be 1..%d\n", MAX_JOBS);
+				return 1;
+			}
+			opt_jobs = (int)v;
+			break;
+		}
+		case OPT_INFO:
+			if (strcmp(optarg, "all") != 0 && strcmp(optarg, "each") != 0) {
+				fprintf(stderr, "mlsblk: --info must be each or all\n");
+				return 1;
+			}
+			opt_info_all = optarg[0] == 'a';
+			break;
+		case OPT_RECORD: opt_record = optarg; break;
+		case OPT_REPLAY: opt_replay = optarg; break;
+		case OPT_TIMING: opt_timing = optarg ? optarg : "text"; timing_env = false; break;
+		case OPT_TRACE_FILE: timing.trace_path = optarg; break;
+		case OPT_PERF: perf_open(); break;
+		case OPT_MEM_STATS: mem.on = true; break;
+		case OPT_EXPLAIN: plan.explain = true; break;
+		default:
+			fprintf(stderr, "Usage: mlsblk [-f] [-o COL1,COL2] [-J | -l | -r | -P | --csv | --ndjson] [--jobs N] [--info=each|all] [--record DIR | --replay DIR] [--timing[=json]] [--trace-file FILE] [--perf-counters] [--mem-stats] [--explain]\n");
+			fprintf(stderr, "  -f        include FSTYPE,LABEL,UUID\n");
+			fprintf(stderr, "  -o        output columns (e.g. NAME,SIZE,FSTYPE,MOUNTPOINT)\n");
+			fprintf(stderr, "  -J        JSON output\n");
+			fprintf(stderr, "  -l        list format instead of tree\n");
+			fprintf(stderr, "  -r        raw list: unaligned, unsafe characters as \\xHH\n");
+			fprintf(stderr, "  -P        KEY=\"value\" pairs, one device per line\n");
+			fprintf(stderr, "  --csv     comma-separated values with a header line\n");
+			fprintf(stderr, "  --ndjson  one JSON object per device, with its parent's name\n");
+			fprintf(stderr, "  --jobs    concurrent diskutil info calls for -f (default: adaptive)\n");
+			fprintf(stderr, "  --info    -f details from one diskutil info per device (each, default) or one info -all (all)\n");
+			fprintf(stderr, "  --record  save raw diskutil output and mount table to DIR\n");
+			fprintf(stderr, "  --replay  read input from a DIR made by --record instead of the system\n");
+			fprintf(stderr, "  --timing  per-phase timing and info latency on stderr (also MLSBLK_TRACE=1|json)\n");
+			fprintf(stderr, "  --trace-file  write a Chrome/Perfetto trace of the run to FILE\n");
+			fprintf(stderr, "  --perf-counters  per-phase cycles, instructions, cache/branch misses, faults (Linux)\n");
+			fprintf(stderr, "  --mem-stats  per-phase allocations, bytes, reallocs, peak heap and peak RSS\n");
+			fprintf(stderr, "  --explain  which data sources each column used and why others were skipped\n");
+			return 1;
+		}
+	}
+	if (opt_timing && *opt_timing && strcmp(opt_timing, "0") != 0) {
+		if (strcmp(opt_timing, "json") == 0) timing.json = true;
+		else if (strcmp(opt_timing, "text") != 0 && strcmp(opt_timing, "1") != 0) {
+			if (!timing_env) {
+				fprintf(stderr, "mlsblk: --timing must be text or json\n");
+				return 1;
+			}
+			/* an environment variable must not break normal output */
+			fprintf(stderr, "mlsblk: ignoring MLSBLK_TRACE=%s (use 1 or json)\n", opt_timing);
+			opt_timing = NULL;
+		}
+		if (opt_timing) timing.report = true;
+	}
+	if (timing.report || timing.trace_path || perf.on || mem.on) {
+		timing.on = true;
+		timing.t0 = now_ns();
+	}
+	if (opt_record && opt_replay) {
+		fprintf(stderr, "mlsblk: --record and --replay are mutually exclusive\n");
+		return 1;
+	}
+	if (opt_record && mkdir(opt_record, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "mlsblk: cannot create %s: %s\n", opt_record, strerror(errno));
+		return 1;
+	}
+
+	int *cols = NULL, ncols = 0;
+	if (parse_output_option(opt_o, &cols, &ncols) != 0) {
+		fprintf(stderr, "mlsblk: invalid -o columns\n");
+		return 1;
+	}
+	if (opt_f && !opt_o) {
+		parse_columns("NAME,SIZE,TYPE,FSTYPE,MOUNTPOINT,LABEL,UUID", &cols, &ncols);
+	}
+
+	Source src;
+	source_init(&src, opt_record, opt_replay);
+	int rc;
+	plan_init(&plan, cols, ncols, &src, opt_f, opt_info_all, opt_record != NULL);
+
+	/* Nodes are built while diskutil list is still writing (or read from sysfs) */
+	NodeArray flat = { 0 };
+	uint64_t t;
+	if (src.scan) {
+		t = phase_begin(PH_LIST);
+		rc = src.scan(&src, &flat);
+		phase_end(PH_LIST, t);
+		if (rc != 0) {
+			fprintf(stderr, "mlsblk: cannot read block devices from sysfs\n");
+			return 1;
+		}
+		t = phase_begin(PH_SORT);
+		node_array_sort(&flat);
+		phase_end(PH_SORT, t);
+	} else {
+		ListBuilder lb;
+		list_builder_init(&lb, &flat);
+		t = phase_begin(PH_LIST);
+		rc = src.list(&src, list_builder_feed, &lb);
+		phase_end(PH_LIST, t);
+		if (rc != 0) {
+			list_builder_finish(&lb);
+			if (opt_replay)
+				fprintf(stderr, "mlsblk: cannot read %s/list.plist\n", opt_replay);
+			else
+				fprintf(stderr, "mlsblk: failed to run diskutil list -plist\n");
+			return 1;
+		}
+		t = phase_begin(PH_SORT);
+		rc = list_builder_finish(&lb);
+		phase_end(PH_SORT, t);
+		if (rc != 0) {
+			fprintf(stderr, "mlsblk: failed to parse disk list\n");
+			return 1;
+		}
+	}
+
+	/* Every later source runs only if a requested column still needs it */
+	plan_done(&plan, &flat, SRC_LIST);
+	MountTable mounts;
+	if (plan_step(&plan, &flat, SRC_MOUNTS)) {
+		t = phase_begin(PH_MOUNTS);
+		rc = src.mounts(&src, &mounts);
+		phase_end(PH_MOUNTS, t);
+		if (rc == 0) {
+			t = phase_begin(PH_JOIN);
+			fill_mountpoints(&flat, &mounts, !opt_replay);
+			phase_end(PH_JOIN, t);
+			mount_table_release(&mounts);
+		}
+	}
+	plan_done(&plan, &flat, SRC_MOUNTS);
+
+	/* APFS details in one call; diskutil info is then only asked about the rest */
+	if (plan_step(&plan, &flat, SRC_APFS)) {
+		Blob b;
+		t = phase_begin(PH_APFS);
+		if (src.bulk(&src, apfs_args, "apfs.plist", &b) == 0) {
+			apfs_fill(&flat, &b);
+			blob_release(&b);
+		}
+		phase_end(PH_APFS, t);
+	}
+	plan_done(&plan, &flat, SRC_APFS);
+
+	/* --info=all: one diskutil info -all; devices it left out still get their own call */
+	if (plan_step(&plan, &flat, SRC_INFO_ALL)) {
+		Blob b;
+		t = phase_begin(PH_INFO);
+		if (src.bulk(&src, info_all_args, "info-all.txt", &b) == 0) {
+			uint64_t tp = phase_begin(PH_INFO_PARSE);
+			info_all_fill(&flat, &b);
+			phase_end(PH_INFO_PARSE, tp);
+			blob_release(&b);
+		}
+		phase_end(PH_INFO, t);
+	}
+	plan_done(&plan, &flat, SRC_INFO_ALL);
+	int each = src.scan ? SRC_CACHE : SRC_SPAWN;
+	if (plan_step(&plan, &flat, each)) {
+		Node **todo = mem_malloc(((size_t)flat.n + 1) * sizeof(Node *));
+		int ntodo = 0;
+		unsigned fields = plan.need & K_INFO;
+		for (int i = 0; todo && i < flat.n; i++)
+			if (fields & ~flat.arr[i]->known) todo[ntodo++] = flat.arr[i];
+		t = phase_begin(PH_INFO);
+		if (todo) src.info(&src, todo, ntodo, opt_jobs, fill_info_reply, &flat.arena);
+		phase_end(PH_INFO, t);
+		mem_free(todo);
+	}
+	plan_done(&plan, &flat, each);
+
+	/* Print from the compact table; the pointer tree is no longer needed */
+	NodeTable table;
+	t = phase_begin(PH_FREEZE);
+	rc = node_table_freeze(&table, &flat);
+	node_array_free(&flat);
+	phase_end(PH_FREEZE, t);
+	if (rc != 0) {
+		node_table_free(&table);
+		fprintf(stderr, "mlsblk: out of memory\n");
+		return 1;
+	}
+
+	Out out;
+	if (out_open(&out, STDOUT_FILENO) != 0) {
+		node_table_free(&table);
+		fprintf(stderr, "mlsblk: out of memory\n");
+		return 1;
+	}
+	t = phase_begin(PH_OUTPUT);
+	if (opt_J)
+		print_json(&out, &table, cols, ncols);
+	else if (opt_fmt >= 0)
+		rc = print_rows(&out, &table, cols, ncols, opt_fmt);
+	else if (opt_list)
+		rc = print_rows(&out, &table, cols, ncols, FMT_LIST);
+	else
+		rc = print_trees(&out, &table, cols, ncols);
+	if (rc != 0) {
+		out_close(&out);
+		fprintf(stderr, "mlsblk: out of memory\n");
+	} else if ((rc = out_close(&out)) != 0) {
+		fprintf(stderr, "mlsblk: write error: %s\n", strerror(errno));
+	}
+	phase_end(PH_OUTPUT, t);
+
+	node_table_free(&table);
+	plan_explain(&plan, cols, ncols);
+	mem_free(cols);
+	timing_report();
+	perf_report();
+	trace_write();
+	mem_report();
+	return rc ? 1 : 0;
+}